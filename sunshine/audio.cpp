@@ -8,12 +8,15 @@
 #include "config.h"
 #include "main.h"
 #include "thread_safe.h"
+#include "trace.h"
 #include "utility.h"
 
 namespace audio {
 using namespace std::literals;
-using opus_t         = util::safe_ptr<OpusMSEncoder, opus_multistream_encoder_destroy>;
-using sample_queue_t = std::shared_ptr<safe::queue_t<std::vector<std::int16_t>>>;
+using opus_t = util::safe_ptr<OpusMSEncoder, opus_multistream_encoder_destroy>;
+
+// Only the capture thread raises samples
+using sample_queue_t = std::shared_ptr<safe::queue_t<std::vector<std::int16_t>, safe::producer_e::single>>;
 
 struct audio_ctx_t {
   // We want to change the sink for the first stream only
@@ -72,9 +75,7 @@ opus_stream_config_t stream_configs[MAX_STREAM_CONFIG] {
 
 auto control_shared = safe::make_shared<audio_ctx_t>(start_audio_control, stop_audio_control);
 
-void encodeThread(sample_queue_t samples, config_t config, void *channel_data) {
-  auto packets = mail::man->queue<packet_t>(mail::audio_packets);
-
+void encodeThread(sample_queue_t samples, config_t config, packet_queue_t packets, safe::mail_raw_t::event_t<bool> shutdown_event, void *channel_data) {
   //FIXME: Pick correct opus_stream_config_t based on config.channels
   auto stream = &stream_configs[map_stream(config.channels, config.flags[config_t::HIGH_QUALITY])];
 
@@ -93,10 +94,16 @@ void encodeThread(sample_queue_t samples, config_t config, void *channel_data) {
   while(auto sample = samples->pop()) {
     buffer_t packet { 1024 }; // 1KB
 
+    trace::scope_t span { "audio", "opus_encode" };
     int bytes = opus_multistream_encode(opus.get(), sample->data(), frame_size, std::begin(packet), packet.size());
+    span.end();
+
     if(bytes < 0) {
       BOOST_LOG(error) << "Couldn't encode audio: "sv << opus_strerror(bytes);
-      packets->stop();
+
+      // End this session only, the packet queue is shared with other sessions
+      samples->stop();
+      shutdown_event->raise(true);
 
       return;
     }
@@ -106,7 +113,7 @@ void encodeThread(sample_queue_t samples, config_t config, void *channel_data) {
   }
 }
 
-void capture(safe::mail_t mail, config_t config, void *channel_data) {
+void capture(safe::mail_t mail, config_t config, packet_queue_t packets, stats::session_t &stats, void *channel_data) {
   auto shutdown_event = mail->event<bool>(mail::shutdown);
 
   //FIXME: Pick correct opus_stream_config_t based on config.channels
@@ -152,7 +159,7 @@ void capture(safe::mail_t mail, config_t config, void *channel_data) {
   }
 
   auto samples = std::make_shared<sample_queue_t::element_type>(30);
-  std::thread thread { encodeThread, samples, config, channel_data };
+  std::thread thread { encodeThread, samples, config, std::move(packets), shutdown_event, channel_data };
 
   auto fg = util::fail_guard([&]() {
     samples->stop();
@@ -175,11 +182,15 @@ void capture(safe::mail_t mail, config_t config, void *channel_data) {
     std::vector<std::int16_t> sample_buffer;
     sample_buffer.resize(samples_per_frame);
 
+    trace::scope_t span { "audio", "sample" };
     auto status = mic->sample(sample_buffer);
+    span.end();
+
     switch(status) {
     case platf::capture_e::ok:
       break;
     case platf::capture_e::timeout:
+      stats.add(stats::AUDIO_UNDERRUNS);
       continue;
     case platf::capture_e::reinit:
       mic.reset();
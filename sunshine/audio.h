@@ -1,6 +1,7 @@
 #ifndef SUNSHINE_AUDIO_H
 #define SUNSHINE_AUDIO_H
 
+#include "stats.h"
 #include "thread_safe.h"
 #include "utility.h"
 namespace audio {
@@ -37,9 +38,10 @@ struct config_t {
   std::bitset<MAX_FLAGS> flags;
 };
 
-using buffer_t = util::buffer_t<std::uint8_t>;
-using packet_t = std::pair<void *, buffer_t>;
-void capture(safe::mail_t mail, config_t config, void *channel_data);
+using buffer_t       = util::buffer_t<std::uint8_t>;
+using packet_t       = std::pair<void *, buffer_t>;
+using packet_queue_t = std::shared_ptr<safe::queue_t<packet_t>>;
+void capture(safe::mail_t mail, config_t config, packet_queue_t packets, stats::session_t &stats, void *channel_data);
 } // namespace audio
 
 #endif
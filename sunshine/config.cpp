@@ -146,6 +146,13 @@ int coder_from_view(const std::string_view &coder) {
 }
 } // namespace amd
 
+int overflow_from_view(const std::string_view &overflow) {
+  if(overflow == "block"sv) return stream_t::BLOCK;
+  if(overflow == "drop"sv) return stream_t::DROP;
+
+  return stream_t::IDR;
+}
+
 video_t video {
   0,  // crf
   28, // qp
@@ -180,8 +187,17 @@ stream_t stream {
 
   APPS_JSON_PATH,
 
-  20, // fecPercentage
-  1   // channels
+  20,    // fecPercentage
+  false, // adaptive_fec
+  5,     // min_fec_percentage
+  80,    // max_fec_percentage
+  1,     // channels
+
+  0,     // pacing_percentage
+  false, // pacing_txtime
+  false, // inline_send
+
+  stream_t::IDR, // video_queue_overflow
 };
 
 nvhttp_t nvhttp {
@@ -211,9 +227,10 @@ nvhttp_t nvhttp {
 };
 
 input_t input {
-  2s,                                        // back_button_timeout
-  500ms,                                     // key_repeat_delay
-  std::chrono::duration<double> { 1 / 24.9 } // key_repeat_period
+  2s,                                         // back_button_timeout
+  500ms,                                      // key_repeat_delay
+  std::chrono::duration<double> { 1 / 24.9 }, // key_repeat_period
+  0us,                                        // coalesce_window
 };
 
 sunshine_t sunshine {
@@ -225,7 +242,8 @@ sunshine_t sunshine {
   {},                                   // Password Salt
   SUNSHINE_ASSETS_DIR "/sunshine.conf", // config file
   {},                                   // cmd args
-  47989,
+  47989,                                // port
+  false,                                // trace
 };
 
 bool endline(char ch) {
@@ -625,6 +643,13 @@ void apply_config(std::unordered_map<std::string, std::string> &&vars) {
 
   path_f(vars, "file_apps", stream.file_apps);
   int_between_f(vars, "fec_percentage", stream.fec_percentage, { 1, 255 });
+  bool_f(vars, "adaptive_fec", stream.adaptive_fec);
+  int_between_f(vars, "min_fec_percentage", stream.min_fec_percentage, { 1, 255 });
+  int_between_f(vars, "max_fec_percentage", stream.max_fec_percentage, { stream.min_fec_percentage, 255 });
+  int_between_f(vars, "pacing", stream.pacing_percentage, { 0, 100 });
+  bool_f(vars, "pacing_txtime", stream.pacing_txtime);
+  bool_f(vars, "inline_send", stream.inline_send);
+  int_f(vars, "video_queue_overflow", stream.video_queue_overflow, overflow_from_view);
 
   to = std::numeric_limits<int>::min();
   int_f(vars, "back_button_timeout", to);
@@ -646,6 +671,12 @@ void apply_config(std::unordered_map<std::string, std::string> &&vars) {
     input.key_repeat_delay = std::chrono::milliseconds { to };
   }
 
+  to = -1;
+  int_between_f(vars, "mouse_coalesce_window", to, { 0, 100000 });
+  if(to >= 0) {
+    input.coalesce_window = std::chrono::microseconds { to };
+  }
+
   int port = sunshine.port;
   int_f(vars, "port"s, port);
   sunshine.port = (std::uint16_t)port;
@@ -653,6 +684,8 @@ void apply_config(std::unordered_map<std::string, std::string> &&vars) {
   bool upnp = false;
   bool_f(vars, "upnp"s, upnp);
 
+  bool_f(vars, "trace"s, sunshine.trace);
+
   if(upnp) {
     config::sunshine.flags[config::flag::UPNP].flip();
   }
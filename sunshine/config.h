@@ -45,14 +45,37 @@ struct audio_t {
 };
 
 struct stream_t {
+  // What a video worker does with a frame when it falls behind
+  enum overflow_e : int {
+    BLOCK, // Hold up the encoder until the worker has room
+    DROP,  // Drop the frame that doesn't fit
+    IDR,   // Drop the queued frames of the session and request an IDR frame
+  };
+
   std::chrono::milliseconds ping_timeout;
 
   std::string file_apps;
 
   int fec_percentage;
 
+  // Let each session move its FEC percentage between min and max, following the loss its client reports
+  bool adaptive_fec;
+  int min_fec_percentage;
+  int max_fec_percentage;
+
   // max unique instances of video and audio streams
   int channels;
+
+  // Percentage of the frame interval the packets of a video frame are spread over, 0 sends them at once
+  int pacing_percentage;
+
+  // Let the kernel release paced packets at their scheduled time with SO_TXTIME
+  bool pacing_txtime;
+
+  // Send video packets from the encoding thread instead of handing them to a video worker
+  bool inline_send;
+
+  int video_queue_overflow;
 };
 
 struct nvhttp_t {
@@ -77,6 +100,9 @@ struct input_t {
   std::chrono::milliseconds back_button_timeout;
   std::chrono::milliseconds key_repeat_delay;
   std::chrono::duration<double> key_repeat_period;
+
+  // How long to wait for more relative mouse movement and scrolling to merge
+  std::chrono::microseconds coalesce_window;
 };
 
 namespace flag {
@@ -108,6 +134,9 @@ struct sunshine_t {
   } cmd;
 
   std::uint16_t port;
+
+  // Record the spans of the streaming pipeline, the web UI switches it at runtime
+  bool trace;
 };
 
 extern video_t video;
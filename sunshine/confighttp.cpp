@@ -27,6 +27,8 @@
 #include "nvhttp.h"
 #include "platform/common.h"
 #include "rtsp.h"
+#include "stats.h"
+#include "trace.h"
 #include "utility.h"
 #include "uuid.h"
 
@@ -335,6 +337,29 @@ void getConfig(resp_https_t response, req_https_t request) {
   }
 }
 
+void getMetrics(resp_https_t response, req_https_t request) {
+  if(!authenticate(response, request)) return;
+
+  print_req(request);
+
+  const SimpleWeb::CaseInsensitiveMultimap headers {
+    { "Content-Type", "text/plain; version=0.0.4" }
+  };
+  response->write(stats::scrape(), headers);
+}
+
+void getTrace(resp_https_t response, req_https_t request) {
+  if(!authenticate(response, request)) return;
+
+  print_req(request);
+
+  const SimpleWeb::CaseInsensitiveMultimap headers {
+    { "Content-Type", "application/json" },
+    { "Content-Disposition", R"(attachment; filename="sunshine-trace.json")" }
+  };
+  response->write(trace::dump(), headers);
+}
+
 void saveConfig(resp_https_t response, req_https_t request) {
   if(!authenticate(response, request)) return;
 
@@ -361,6 +386,9 @@ void saveConfig(resp_https_t response, req_https_t request) {
       configStream << kv.first << " = " << value << std::endl;
     }
     write_file(config::sunshine.config_file.c_str(), configStream.str());
+
+    // Unlike the other options, tracing doesn't wait for a restart
+    trace::enable(inputTree.get<std::string>("trace", "disabled") == "enabled");
   }
   catch(std::exception &e) {
     BOOST_LOG(warning) << "SaveConfig: "sv << e.what();
@@ -473,6 +501,8 @@ void start() {
   server.resource["^/api/config$"]["GET"]           = getConfig;
   server.resource["^/api/config$"]["POST"]          = saveConfig;
   server.resource["^/api/password$"]["POST"]        = savePassword;
+  server.resource["^/api/trace$"]["GET"]            = getTrace;
+  server.resource["^/metrics$"]["GET"]              = getMetrics;
   server.resource["^/api/apps/([0-9]+)$"]["DELETE"] = deleteApp;
   server.config.reuse_address                       = true;
   server.config.address                             = "0.0.0.0"s;
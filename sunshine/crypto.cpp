@@ -84,74 +84,88 @@ int cipher_t::decrypt(const std::string_view &cipher, std::vector<std::uint8_t>
   return 0;
 }
 
-int cipher_t::decrypt_gcm(aes_t &iv, const std::string_view &tagged_cipher,
-  std::vector<std::uint8_t> &plaintext) {
-  auto cipher = tagged_cipher.substr(16);
-  auto tag    = tagged_cipher.substr(0, 16);
+int cipher_t::encrypt(const std::string_view &plaintext, std::vector<std::uint8_t> &cipher) {
+  int len;
 
   auto fg = util::fail_guard([this]() {
     EVP_CIPHER_CTX_reset(ctx.get());
   });
 
-  if(EVP_DecryptInit_ex(ctx.get(), EVP_aes_128_gcm(), nullptr, nullptr, nullptr) != 1) {
+  // Gen 7 servers use 128-bit AES ECB
+  if(EVP_EncryptInit_ex(ctx.get(), EVP_aes_128_ecb(), nullptr, key.data(), nullptr) != 1) {
     return -1;
   }
 
-  if(EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, iv.size(), nullptr) != 1) {
+  EVP_CIPHER_CTX_set_padding(ctx.get(), padding);
+
+  cipher.resize((plaintext.size() + 15) / 16 * 16);
+  auto size = (int)cipher.size();
+  // Encrypt into the caller's buffer
+  if(EVP_EncryptUpdate(ctx.get(), cipher.data(), &size, (const std::uint8_t *)plaintext.data(), plaintext.size()) != 1) {
     return -1;
   }
 
-  if(EVP_DecryptInit_ex(ctx.get(), nullptr, nullptr, key.data(), iv.data()) != 1) {
+  if(EVP_EncryptFinal_ex(ctx.get(), cipher.data() + size, &len) != 1) {
     return -1;
   }
 
-  EVP_CIPHER_CTX_set_padding(ctx.get(), padding);
-  plaintext.resize((cipher.size() + 15) / 16 * 16);
+  cipher.resize(len + size);
+  return 0;
+}
 
-  int size;
-  if(EVP_DecryptUpdate(ctx.get(), plaintext.data(), &size, (const std::uint8_t *)cipher.data(), cipher.size()) != 1) {
-    return -1;
+gcm_t::gcm_t(const aes_t &key) : ctx { EVP_CIPHER_CTX_new() } {
+  auto fg = util::fail_guard([this]() {
+    ctx.reset();
+  });
+
+  if(EVP_DecryptInit_ex(ctx.get(), EVP_aes_128_gcm(), nullptr, nullptr, nullptr) != 1) {
+    return;
   }
 
-  if(EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, tag.size(), const_cast<char *>(tag.data())) != 1) {
-    return -1;
+  if(EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, std::tuple_size_v<aes_t>, nullptr) != 1) {
+    return;
   }
 
-  int len = size;
-  if(EVP_DecryptFinal_ex(ctx.get(), plaintext.data() + size, &len) != 1) {
-    return -1;
+  if(EVP_DecryptInit_ex(ctx.get(), nullptr, nullptr, key.data(), nullptr) != 1) {
+    return;
   }
 
-  plaintext.resize(size + len);
-  return 0;
+  EVP_CIPHER_CTX_set_padding(ctx.get(), false);
+
+  fg.disable();
 }
 
-int cipher_t::encrypt(const std::string_view &plaintext, std::vector<std::uint8_t> &cipher) {
-  int len;
+int gcm_t::decrypt(const aes_t &iv, const std::string_view &tagged_cipher, std::vector<std::uint8_t> &plaintext) {
+  if(!ctx || tagged_cipher.size() < 16) {
+    return -1;
+  }
 
-  auto fg = util::fail_guard([this]() {
-    EVP_CIPHER_CTX_reset(ctx.get());
-  });
+  auto cipher = tagged_cipher.substr(16);
+  auto tag    = tagged_cipher.substr(0, 16);
 
-  // Gen 7 servers use 128-bit AES ECB
-  if(EVP_EncryptInit_ex(ctx.get(), EVP_aes_128_ecb(), nullptr, key.data(), nullptr) != 1) {
+  // Without a key, the key schedule from the constructor is kept
+  if(EVP_DecryptInit_ex(ctx.get(), nullptr, nullptr, nullptr, iv.data()) != 1) {
     return -1;
   }
 
-  EVP_CIPHER_CTX_set_padding(ctx.get(), padding);
+  // GCM is a stream cipher, the plaintext is as long as the cipher
+  plaintext.resize(cipher.size());
 
-  cipher.resize((plaintext.size() + 15) / 16 * 16);
-  auto size = (int)cipher.size();
-  // Encrypt into the caller's buffer
-  if(EVP_EncryptUpdate(ctx.get(), cipher.data(), &size, (const std::uint8_t *)plaintext.data(), plaintext.size()) != 1) {
+  int size;
+  if(EVP_DecryptUpdate(ctx.get(), plaintext.data(), &size, (const std::uint8_t *)cipher.data(), cipher.size()) != 1) {
     return -1;
   }
 
-  if(EVP_EncryptFinal_ex(ctx.get(), cipher.data() + size, &len) != 1) {
+  if(EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, tag.size(), const_cast<char *>(tag.data())) != 1) {
     return -1;
   }
 
-  cipher.resize(len + size);
+  int len;
+  if(EVP_DecryptFinal_ex(ctx.get(), plaintext.data() + size, &len) != 1) {
+    return -1;
+  }
+
+  plaintext.resize(size + len);
   return 0;
 }
 
@@ -74,7 +74,6 @@ public:
 
   int encrypt(const std::string_view &plaintext, std::vector<std::uint8_t> &cipher);
 
-  int decrypt_gcm(aes_t &iv, const std::string_view &cipher, std::vector<std::uint8_t> &plaintext);
   int decrypt(const std::string_view &cipher, std::vector<std::uint8_t> &plaintext);
 
 private:
@@ -84,6 +83,28 @@ private:
 public:
   bool padding;
 };
+
+/**
+ * AES-128-GCM decryption that sets up the key schedule once
+ * Every message only resets the IV.
+ */
+class gcm_t {
+public:
+  gcm_t() = default;
+  gcm_t(const aes_t &key);
+  gcm_t(gcm_t &&) noexcept = default;
+  gcm_t &operator=(gcm_t &&) noexcept = default;
+
+  /**
+   * @param tagged_cipher The 16 byte tag, followed by the cipher
+   * @param plaintext Reused between calls, it only grows
+   * @return -1 on failure, 0 on success
+   */
+  int decrypt(const aes_t &iv, const std::string_view &tagged_cipher, std::vector<std::uint8_t> &plaintext);
+
+private:
+  cipher_ctx_t ctx;
+};
 } // namespace crypto
 
 #endif //SUNSHINE_CRYPTO_H
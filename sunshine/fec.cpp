@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SUNSHINE_FEC_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SUNSHINE_FEC_NEON
+#include <arm_neon.h>
+#endif
+
+#include "fec.h"
+#include "main.h"
+
+using namespace std::literals;
+namespace fec {
+
+// x^8 + x^4 + x^3 + x^2 + 1, the field rs.c computes in
+constexpr int GF_POLYNOMIAL = 0x11d;
+
+static std::uint8_t mul_table[256][256];
+
+// The products of a coefficient with every low nibble and every high nibble,
+// which turns a multiplication into two 16 byte table lookups
+alignas(16) static std::uint8_t nibble_table[256][2][16];
+
+/**
+ * out  = coef * in, if add is false
+ * out ^= coef * in, if add is true
+ */
+using kernel_t = void (*)(std::uint8_t *out, const std::uint8_t *in, std::uint8_t coef, std::size_t size, bool add);
+
+static void mul_scalar(std::uint8_t *out, const std::uint8_t *in, std::uint8_t coef, std::size_t size, bool add) {
+  auto row = mul_table[coef];
+
+  if(add) {
+    for(std::size_t x = 0; x < size; ++x) {
+      out[x] ^= row[in[x]];
+    }
+  }
+  else {
+    for(std::size_t x = 0; x < size; ++x) {
+      out[x] = row[in[x]];
+    }
+  }
+}
+
+#ifdef SUNSHINE_FEC_X86
+__attribute__((target("ssse3"))) static void mul_ssse3(std::uint8_t *out, const std::uint8_t *in, std::uint8_t coef, std::size_t size, bool add) {
+  auto table_lo = _mm_load_si128((const __m128i *)nibble_table[coef][0]);
+  auto table_hi = _mm_load_si128((const __m128i *)nibble_table[coef][1]);
+  auto mask     = _mm_set1_epi8(0x0f);
+
+  std::size_t x = 0;
+  for(; x + 16 <= size; x += 16) {
+    auto data = _mm_loadu_si128((const __m128i *)(in + x));
+
+    auto lo = _mm_shuffle_epi8(table_lo, _mm_and_si128(data, mask));
+    auto hi = _mm_shuffle_epi8(table_hi, _mm_and_si128(_mm_srli_epi64(data, 4), mask));
+
+    auto product = _mm_xor_si128(lo, hi);
+    if(add) {
+      product = _mm_xor_si128(product, _mm_loadu_si128((const __m128i *)(out + x)));
+    }
+
+    _mm_storeu_si128((__m128i *)(out + x), product);
+  }
+
+  mul_scalar(out + x, in + x, coef, size - x, add);
+}
+
+__attribute__((target("avx2"))) static void mul_avx2(std::uint8_t *out, const std::uint8_t *in, std::uint8_t coef, std::size_t size, bool add) {
+  auto table_lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)nibble_table[coef][0]));
+  auto table_hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)nibble_table[coef][1]));
+  auto mask     = _mm256_set1_epi8(0x0f);
+
+  std::size_t x = 0;
+  for(; x + 32 <= size; x += 32) {
+    auto data = _mm256_loadu_si256((const __m256i *)(in + x));
+
+    auto lo = _mm256_shuffle_epi8(table_lo, _mm256_and_si256(data, mask));
+    auto hi = _mm256_shuffle_epi8(table_hi, _mm256_and_si256(_mm256_srli_epi64(data, 4), mask));
+
+    auto product = _mm256_xor_si256(lo, hi);
+    if(add) {
+      product = _mm256_xor_si256(product, _mm256_loadu_si256((const __m256i *)(out + x)));
+    }
+
+    _mm256_storeu_si256((__m256i *)(out + x), product);
+  }
+
+  // Calling into the SSE kernel for the remainder would stall on the switch between VEX and legacy encoding
+  if(x + 16 <= size) {
+    auto data = _mm_loadu_si128((const __m128i *)(in + x));
+
+    auto lo = _mm_shuffle_epi8(_mm256_castsi256_si128(table_lo), _mm_and_si128(data, _mm256_castsi256_si128(mask)));
+    auto hi = _mm_shuffle_epi8(_mm256_castsi256_si128(table_hi), _mm_and_si128(_mm_srli_epi64(data, 4), _mm256_castsi256_si128(mask)));
+
+    auto product = _mm_xor_si128(lo, hi);
+    if(add) {
+      product = _mm_xor_si128(product, _mm_loadu_si128((const __m128i *)(out + x)));
+    }
+
+    _mm_storeu_si128((__m128i *)(out + x), product);
+    x += 16;
+  }
+
+  mul_scalar(out + x, in + x, coef, size - x, add);
+}
+#endif
+
+#ifdef SUNSHINE_FEC_NEON
+static void mul_neon(std::uint8_t *out, const std::uint8_t *in, std::uint8_t coef, std::size_t size, bool add) {
+  auto table_lo = vld1q_u8(nibble_table[coef][0]);
+  auto table_hi = vld1q_u8(nibble_table[coef][1]);
+  auto mask     = vdupq_n_u8(0x0f);
+
+  std::size_t x = 0;
+  for(; x + 16 <= size; x += 16) {
+    auto data = vld1q_u8(in + x);
+
+    auto product = veorq_u8(vqtbl1q_u8(table_lo, vandq_u8(data, mask)), vqtbl1q_u8(table_hi, vshrq_n_u8(data, 4)));
+    if(add) {
+      product = veorq_u8(product, vld1q_u8(out + x));
+    }
+
+    vst1q_u8(out + x, product);
+  }
+
+  mul_scalar(out + x, in + x, coef, size - x, add);
+}
+#endif
+
+static kernel_t kernel = mul_scalar;
+
+void init() {
+  std::uint8_t exp[512];
+  int log[256] {};
+
+  int x = 1;
+  for(int i = 0; i < 255; ++i) {
+    exp[i] = x;
+    log[x] = i;
+
+    x <<= 1;
+    if(x & 0x100) {
+      x ^= GF_POLYNOMIAL;
+    }
+  }
+
+  std::copy_n(exp, 255, exp + 255);
+
+  for(int a = 0; a < 256; ++a) {
+    for(int b = 0; b < 256; ++b) {
+      mul_table[a][b] = (a && b) ? exp[log[a] + log[b]] : 0;
+    }
+
+    for(int nibble = 0; nibble < 16; ++nibble) {
+      nibble_table[a][0][nibble] = mul_table[a][nibble];
+      nibble_table[a][1][nibble] = mul_table[a][nibble << 4];
+    }
+  }
+
+  auto name = "scalar"sv;
+#if defined(SUNSHINE_FEC_X86)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) {
+    kernel = mul_avx2;
+    name   = "avx2"sv;
+  }
+  else if(__builtin_cpu_supports("ssse3")) {
+    kernel = mul_ssse3;
+    name   = "ssse3"sv;
+  }
+#elif defined(SUNSHINE_FEC_NEON)
+  kernel = mul_neon;
+  name   = "neon"sv;
+#endif
+
+  BOOST_LOG(debug) << "Reed Solomon parity kernel: "sv << name;
+}
+
+rs_t codec(int data_shards, int parity_shards) {
+  static std::mutex codecs_lock;
+  static std::unordered_map<int, rs_t> codecs;
+
+  std::lock_guard lg { codecs_lock };
+
+  auto &rs = codecs[data_shards << 8 | parity_shards];
+  if(!rs) {
+    rs = rs_t { reed_solomon_new(data_shards, parity_shards), reed_solomon_release };
+  }
+
+  return rs;
+}
+
+void encode_parity(const reed_solomon *rs, std::uint8_t **shards, std::size_t blocksize) {
+  auto data_shards = rs->data_shards;
+
+  for(int row = 0; row < rs->parity_shards; ++row) {
+    auto out  = shards[data_shards + row];
+    auto coef = &rs->parity[row * data_shards];
+
+    for(int x = 0; x < data_shards; ++x) {
+      kernel(out, shards[x], coef[x], blocksize, x != 0);
+    }
+  }
+}
+
+size_t parity_shards(size_t data_shards, size_t fecpercentage, size_t minparityshards) {
+  auto parity_shards = std::max((data_shards * fecpercentage + 99) / 100, minparityshards);
+
+  if(data_shards + parity_shards > DATA_SHARDS_MAX) {
+    return 0;
+  }
+
+  return parity_shards;
+}
+
+fec_t encode(char *shards, size_t data_shards, size_t blocksize, size_t fecpercentage, size_t minparityshards) {
+  auto nr_parity_shards = parity_shards(data_shards, fecpercentage, minparityshards);
+
+  if(!nr_parity_shards) {
+    if(fecpercentage || minparityshards) {
+      BOOST_LOG(warning)
+        << "Number of fragments for reed solomon exceeds DATA_SHARDS_MAX"sv << std::endl
+        << data_shards << " data shards, "sv << fecpercentage << "% FEC"sv
+        << ", skipping error correction"sv;
+    }
+
+    fecpercentage = 0;
+  }
+  else if(nr_parity_shards > (data_shards * fecpercentage + 99) / 100) {
+    // increase the FEC percentage for this frame if the parity shard minimum is not met
+    fecpercentage = (100 * nr_parity_shards) / data_shards;
+
+    BOOST_LOG(verbose) << "Increasing FEC percentage to "sv << fecpercentage << " to meet parity shard minimum"sv << std::endl;
+  }
+
+  auto nr_shards = data_shards + nr_parity_shards;
+
+  if(nr_parity_shards) {
+    std::array<std::uint8_t *, DATA_SHARDS_MAX> shards_p;
+    for(auto x = 0; x < nr_shards; ++x) {
+      shards_p[x] = (std::uint8_t *)&shards[x * blocksize];
+    }
+
+    auto rs = codec(data_shards, nr_parity_shards);
+    encode_parity(rs.get(), shards_p.data(), blocksize);
+  }
+
+  return {
+    data_shards,
+    nr_shards,
+    fecpercentage,
+    blocksize,
+    shards
+  };
+}
+} // namespace fec
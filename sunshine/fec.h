@@ -0,0 +1,71 @@
+#ifndef SUNSHINE_FEC_H
+#define SUNSHINE_FEC_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+extern "C" {
+#include <rs.h>
+}
+
+#include "utility.h"
+
+namespace fec {
+using rs_t = std::shared_ptr<reed_solomon>;
+
+/**
+ * The shards of a FEC block, the memory is owned by the caller of encode()
+ */
+struct fec_t {
+  size_t data_shards;
+  size_t nr_shards;
+  size_t percentage;
+
+  size_t blocksize;
+  char *shards;
+
+  char *data(size_t el) {
+    return &shards[el * blocksize];
+  }
+
+  std::string_view operator[](size_t el) const {
+    return { &shards[el * blocksize], blocksize };
+  }
+
+  size_t size() const {
+    return nr_shards;
+  }
+};
+
+/**
+ * Select the fastest parity kernel the cpu supports
+ */
+void init();
+
+/**
+ * Building a codec inverts its coding matrix, codecs are therefore kept around for reuse
+ * @return A codec for data_shards + parity_shards shards
+ */
+rs_t codec(int data_shards, int parity_shards);
+
+/**
+ * Compute the parity shards, the result is byte-identical to reed_solomon_encode()
+ * @param shards rs->data_shards data shards, followed by rs->parity_shards parity shards
+ */
+void encode_parity(const reed_solomon *rs, std::uint8_t **shards, std::size_t blocksize);
+
+/**
+ * @return The number of parity shards encode() appends to data_shards data shards,
+ *         0 if the block would not fit into DATA_SHARDS_MAX shards
+ */
+size_t parity_shards(size_t data_shards, size_t fecpercentage, size_t minparityshards);
+
+/**
+ * Compute the parity of a block in place
+ * @param shards data_shards data shards of blocksize bytes, followed by room for parity_shards() more
+ */
+fec_t encode(char *shards, size_t data_shards, size_t blocksize, size_t fecpercentage, size_t minparityshards);
+} // namespace fec
+
+#endif //SUNSHINE_FEC_H
@@ -9,12 +9,14 @@ extern "C" {
 }
 
 #include <bitset>
+#include <thread>
 
 #include "config.h"
 #include "input.h"
 #include "main.h"
 #include "platform/common.h"
 #include "thread_pool.h"
+#include "trace.h"
 #include "utility.h"
 
 namespace input {
@@ -47,12 +49,43 @@ void free_id(std::bitset<N> &gamepad_mask, int id) {
 }
 
 static util::TaskPool::task_id_t task_id {};
+
+// Changes whenever key repeat is cancelled, a repeat that already left the timer queue is then ignored
+static std::uint32_t key_repeat_generation {};
+
 static std::unordered_map<short, bool> key_press {};
 static std::array<std::uint8_t, 5> mouse_press {};
 
 static platf::input_t platf_input;
 static std::bitset<platf::MAX_GAMEPADS> gamepadMask {};
 
+// Timers and cleanup run on this strand, packets are injected by the input thread of their session
+static std::shared_ptr<util::strand_t> strand;
+
+// The state above is shared by every session, whoever injects input holds this lock
+static std::mutex input_lock;
+
+template<class F>
+void push_locked(F &&f) {
+  strand->push([f = std::forward<F>(f)]() mutable {
+    std::lock_guard lg { input_lock };
+    f();
+  });
+}
+
+/**
+ * Run f on the input strand once duration has passed
+ * @return The id of the timer, it can be cancelled until it fires
+ */
+template<class F, class X, class Y>
+util::TaskPool::task_id_t push_delayed(F &&f, std::chrono::duration<X, Y> duration) {
+  auto post = [f = std::forward<F>(f)]() mutable {
+    push_locked(std::move(f));
+  };
+
+  return task_pool.pushDelayed(std::move(post), duration).task_id;
+}
+
 void free_gamepad(platf::input_t &platf_input, int id) {
   platf::gamepad(platf_input, id, platf::gamepad_state_t {});
   platf::free_gamepad(platf_input, id);
@@ -63,7 +96,7 @@ struct gamepad_t {
   gamepad_t() : gamepad_state {}, back_timeout_id {}, id { -1 }, back_button_state { button_state_e::NONE } {}
   ~gamepad_t() {
     if(id >= 0) {
-      task_pool.push([id = this->id]() {
+      push_locked([id = this->id]() {
         free_gamepad(platf_input, id);
       });
     }
@@ -83,13 +116,45 @@ struct gamepad_t {
   button_state_e back_button_state;
 };
 
+// Larger than any packet the client sends on the input channel
+constexpr std::size_t MAX_PACKET_SIZE = 128;
+
+// Stored inline, so queueing a packet doesn't allocate
+struct packet_t {
+  std::chrono::steady_clock::time_point received;
+  std::array<std::uint8_t, MAX_PACKET_SIZE> data;
+};
+
+// Only the control thread of a session raises packets
+using packet_queue_t = std::shared_ptr<safe::queue_t<packet_t, safe::producer_e::single>>;
+
 struct input_t {
-  input_t(safe::mail_raw_t::event_t<input::touch_port_t> touch_port_event)
-      : active_gamepad_state {},
+  input_t(safe::mail_raw_t::event_t<input::touch_port_t> touch_port_event, std::shared_ptr<stats::session_t> stats)
+      : packets { std::make_shared<packet_queue_t::element_type>(1024, safe::overflow_e::block) },
+        active_gamepad_state {},
         gamepads(MAX_GAMEPADS),
         touch_port_event { std::move(touch_port_event) },
         mouse_left_button_timeout {},
-        touch_port { 0, 0, 0, 0, 0, 0, 1.0f } {}
+        touch_port { 0, 0, 0, 0, 0, 0, 1.0f },
+        events {},
+        latency_total {},
+        latency_max {},
+        stats { std::move(stats) } {}
+
+  ~input_t() {
+    packets->stop();
+
+    // The input thread may hold the last reference
+    if(thread.get_id() == std::this_thread::get_id()) {
+      thread.detach();
+    }
+    else if(thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  packet_queue_t packets;
+  std::thread thread;
 
   std::uint16_t active_gamepad_state;
   std::vector<gamepad_t> gamepads;
@@ -99,6 +164,13 @@ struct input_t {
   util::ThreadPool::task_id_t mouse_left_button_timeout;
 
   input::touch_port_t touch_port;
+
+  // The time from receiving a packet to injecting it
+  std::atomic<std::uint64_t> events;
+  std::atomic<std::int64_t> latency_total;
+  std::atomic<std::int64_t> latency_max;
+
+  std::shared_ptr<stats::session_t> stats;
 };
 
 using namespace std::literals;
@@ -191,11 +263,15 @@ void print(void *input) {
   }
 }
 
-void passthrough(std::shared_ptr<input_t> &input, PNV_REL_MOUSE_MOVE_PACKET packet) {
+void move_mouse(std::shared_ptr<input_t> &input, int deltaX, int deltaY) {
   display_cursor = true;
 
   input->mouse_left_button_timeout = DISABLE_LEFT_BUTTON_DELAY;
-  platf::move_mouse(platf_input, util::endian::big(packet->deltaX), util::endian::big(packet->deltaY));
+  platf::move_mouse(platf_input, deltaX, deltaY);
+}
+
+void passthrough(std::shared_ptr<input_t> &input, PNV_REL_MOUSE_MOVE_PACKET packet) {
+  move_mouse(input, util::endian::big(packet->deltaX), util::endian::big(packet->deltaY));
 }
 
 void passthrough(std::shared_ptr<input_t> &input, PNV_ABS_MOUSE_MOVE_PACKET packet) {
@@ -286,7 +362,7 @@ void passthrough(std::shared_ptr<input_t> &input, PNV_MOUSE_BUTTON_PACKET packet
       input->mouse_left_button_timeout = nullptr;
     };
 
-    input->mouse_left_button_timeout = task_pool.pushDelayed(std::move(f), 10ms).task_id;
+    input->mouse_left_button_timeout = push_delayed(std::move(f), 10ms);
 
     return;
   }
@@ -305,7 +381,12 @@ void passthrough(std::shared_ptr<input_t> &input, PNV_MOUSE_BUTTON_PACKET packet
   platf::button_mouse(platf_input, button, release);
 }
 
-void repeat_key(short key_code) {
+void repeat_key(short key_code, std::uint32_t generation) {
+  // If another key started repeating since, this repeat was cancelled
+  if(generation != key_repeat_generation) {
+    return;
+  }
+
   // If key no longer pressed, stop repeating
   if(!key_press[key_code]) {
     task_id = nullptr;
@@ -314,7 +395,7 @@ void repeat_key(short key_code) {
 
   platf::keyboard(platf_input, key_code & 0x00FF, false);
 
-  task_id = task_pool.pushDelayed(repeat_key, config::input.key_repeat_period, key_code).task_id;
+  task_id = push_delayed([key_code, generation]() { repeat_key(key_code, generation); }, config::input.key_repeat_period);
 }
 
 short map_keycode(short keycode) {
@@ -342,9 +423,10 @@ void passthrough(std::shared_ptr<input_t> &input, PNV_KEYBOARD_PACKET packet) {
       if(task_id) {
         task_pool.cancel(task_id);
       }
+      auto generation = ++key_repeat_generation;
 
       if(config::input.key_repeat_delay.count() > 0) {
-        task_id = task_pool.pushDelayed(repeat_key, config::input.key_repeat_delay, packet->keyCode).task_id;
+        task_id = push_delayed([key_code = packet->keyCode, generation]() { repeat_key(key_code, generation); }, config::input.key_repeat_delay);
       }
     }
     else {
@@ -362,10 +444,14 @@ void passthrough(std::shared_ptr<input_t> &input, PNV_KEYBOARD_PACKET packet) {
   platf::keyboard(platf_input, map_keycode(packet->keyCode), release);
 }
 
-void passthrough(PNV_SCROLL_PACKET packet) {
+void scroll(int distance) {
   display_cursor = true;
 
-  platf::scroll(platf_input, util::endian::big(packet->scrollAmt1));
+  platf::scroll(platf_input, distance);
+}
+
+void passthrough(PNV_SCROLL_PACKET packet) {
+  scroll(util::endian::big(packet->scrollAmt1));
 }
 
 int updateGamepads(std::vector<gamepad_t> &gamepads, std::int16_t old_state, std::int16_t new_state) {
@@ -495,7 +581,7 @@ void passthrough(std::shared_ptr<input_t> &input, PNV_MULTI_CONTROLLER_PACKET pa
           gamepad.back_timeout_id = nullptr;
         };
 
-        gamepad.back_timeout_id = task_pool.pushDelayed(std::move(f), config::input.back_button_timeout).task_id;
+        gamepad.back_timeout_id = push_delayed(std::move(f), config::input.back_button_timeout);
       }
     }
     else if(gamepad.back_timeout_id) {
@@ -509,9 +595,7 @@ void passthrough(std::shared_ptr<input_t> &input, PNV_MULTI_CONTROLLER_PACKET pa
   gamepad.gamepad_state = gamepad_state;
 }
 
-void passthrough_helper(std::shared_ptr<input_t> input, std::vector<std::uint8_t> &&input_data) {
-  void *payload = input_data.data();
-
+void passthrough_helper(std::shared_ptr<input_t> &input, void *payload) {
   int input_type = util::endian::big(*(int *)payload);
 
   switch(input_type) {
@@ -541,16 +625,157 @@ void passthrough_helper(std::shared_ptr<input_t> input, std::vector<std::uint8_t
   }
 }
 
-void passthrough(std::shared_ptr<input_t> &input, std::vector<std::uint8_t> &&input_data) {
-  task_pool.push(passthrough_helper, input, util::cmove(input_data));
+bool is_scroll(void *payload) {
+  return util::endian::big(*(int *)payload) == PACKET_TYPE_SCROLL_OR_KEYBOARD && ((char *)payload)[4] == 0x0A;
+}
+
+/**
+ * Relative mouse movement and scrolling are summed up until a packet of another kind,
+ * buttons and keys are injected in the order they were received
+ */
+void inject(std::shared_ptr<input_t> &input, std::vector<packet_t> &batch) {
+  int deltaX = 0, deltaY = 0, distance = 0;
+  bool moved = false, scrolled = false;
+
+  auto flush = [&]() {
+    if(moved) {
+      move_mouse(input, deltaX, deltaY);
+    }
+    if(scrolled) {
+      scroll(distance);
+    }
+
+    deltaX = deltaY = distance = 0;
+    moved = scrolled = false;
+  };
+
+  for(auto &packet : batch) {
+    void *payload = packet.data.data();
+
+    if(util::endian::big(*(int *)payload) == PACKET_TYPE_REL_MOUSE_MOVE) {
+      auto move = (PNV_REL_MOUSE_MOVE_PACKET)payload;
+
+      deltaX += util::endian::big(move->deltaX);
+      deltaY += util::endian::big(move->deltaY);
+      moved = true;
+    }
+    else if(is_scroll(payload)) {
+      distance += util::endian::big(((PNV_SCROLL_PACKET)payload)->scrollAmt1);
+      scrolled = true;
+    }
+    else {
+      flush();
+      passthrough_helper(input, payload);
+    }
+  }
+
+  flush();
+
+  auto now = std::chrono::steady_clock::now();
+  for(auto &packet : batch) {
+    std::int64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - packet.received).count();
+
+    input->latency_total += latency;
+
+    auto max = input->latency_max.load();
+    while(latency > max && !input->latency_max.compare_exchange_weak(max, latency)) {}
+
+    input->stats->observe(stats::INPUT_LATENCY, std::chrono::nanoseconds { latency });
+  }
+  input->events += batch.size();
+  input->stats->add(stats::INPUT_EVENTS, batch.size());
+}
+
+void inputThread(std::weak_ptr<input_t> weak, packet_queue_t packets) {
+  // Bounds the time the other sessions wait for the input lock
+  constexpr std::size_t MAX_BATCH = 64;
+
+  std::vector<packet_t> batch;
+  while(auto packet = packets->pop()) {
+    batch.emplace_back(std::move(*packet));
+
+    auto mergeable = [](packet_t &packet) {
+      return util::endian::big(*(int *)packet.data.data()) == PACKET_TYPE_REL_MOUSE_MOVE || is_scroll(packet.data.data());
+    };
+
+    // Give the client a moment to send more movement to merge with this one
+    if(config::input.coalesce_window.count() > 0 && mergeable(batch.back())) {
+      auto deadline = batch.back().received + config::input.coalesce_window;
+
+      auto now = std::chrono::steady_clock::now();
+      while(now < deadline && batch.size() < MAX_BATCH) {
+        auto next = packets->pop(deadline - now);
+        if(!next) {
+          break;
+        }
+
+        batch.emplace_back(std::move(*next));
+        if(!mergeable(batch.back())) {
+          break;
+        }
+
+        now = std::chrono::steady_clock::now();
+      }
+    }
+
+    while(batch.size() < MAX_BATCH && packets->peek()) {
+      batch.emplace_back(std::move(*packets->pop()));
+    }
+
+    auto input = weak.lock();
+    if(!input) {
+      break;
+    }
+
+    {
+      std::lock_guard lg { input_lock };
+
+      trace::scope_t span { "input", "inject" };
+      inject(input, batch);
+    }
+
+    batch.clear();
+  }
+}
+
+void passthrough(std::shared_ptr<input_t> &input, const std::vector<std::uint8_t> &input_data) {
+  if(input_data.size() > MAX_PACKET_SIZE) {
+    BOOST_LOG(warning) << "Input packet of "sv << input_data.size() << " bytes is too large"sv;
+
+    return;
+  }
+
+  packet_t packet { std::chrono::steady_clock::now() };
+  std::copy(std::begin(input_data), std::end(input_data), std::begin(packet.data));
+
+  input->packets->raise(std::move(packet));
+}
+
+latency_t latency(std::shared_ptr<input_t> &input) {
+  auto events = input->events.load();
+
+  return {
+    events,
+    std::chrono::nanoseconds { events ? input->latency_total.load() / (std::int64_t)events : 0 },
+    std::chrono::nanoseconds { input->latency_max.load() }
+  };
 }
 
 void reset(std::shared_ptr<input_t> &input) {
-  task_pool.cancel(task_id);
-  task_pool.cancel(input->mouse_left_button_timeout);
+  auto stats = latency(input);
+  if(stats.events) {
+    BOOST_LOG(info)
+      << "Input latency: "sv << std::chrono::duration_cast<std::chrono::microseconds>(stats.average).count()
+      << "us on average, "sv << std::chrono::duration_cast<std::chrono::microseconds>(stats.max).count()
+      << "us at most, over "sv << stats.events << " packets"sv;
+  }
+
+  // Ensure input is synchronous, by using the input strand
+  push_locked([input]() {
+    task_pool.cancel(task_id);
+    task_pool.cancel(input->mouse_left_button_timeout);
+    ++key_repeat_generation;
 
-  // Ensure input is synchronous, by using the task_pool
-  task_pool.push([]() {
     for(int x = 0; x < mouse_press.size(); ++x) {
       if(mouse_press[x]) {
         platf::button_mouse(platf_input, x, true);
@@ -567,13 +792,17 @@ void reset(std::shared_ptr<input_t> &input) {
 
 void init() {
   platf_input = platf::input();
+
+  strand = std::make_shared<util::strand_t>(task_pool, util::priority_e::high);
 }
 
-std::shared_ptr<input_t> alloc(safe::mail_t mail) {
-  auto input = std::make_shared<input_t>(mail->event<input::touch_port_t>(mail::touch_port));
+std::shared_ptr<input_t> alloc(safe::mail_t mail, std::shared_ptr<stats::session_t> stats) {
+  auto input = std::make_shared<input_t>(mail->event<input::touch_port_t>(mail::touch_port), std::move(stats));
+
+  input->thread = std::thread { inputThread, std::weak_ptr<input_t> { input }, input->packets };
 
   // Workaround to ensure new frames will be captured when a client connects
-  task_pool.pushDelayed([]() {
+  push_delayed([]() {
     platf::move_mouse(platf_input, 1, 1);
     platf::move_mouse(platf_input, -1, -1);
   },
@@ -6,20 +6,29 @@
 #define SUNSHINE_INPUT_H
 
 #include "platform/common.h"
+#include "stats.h"
 #include "thread_safe.h"
 
 namespace input {
 
 struct input_t;
 
+// The time from receiving an input packet to injecting it
+struct latency_t {
+  std::uint64_t events;
+  std::chrono::nanoseconds average;
+  std::chrono::nanoseconds max;
+};
+
 void print(void *input);
 void reset(std::shared_ptr<input_t> &input);
-void passthrough(std::shared_ptr<input_t> &input, std::vector<std::uint8_t> &&input_data);
+void passthrough(std::shared_ptr<input_t> &input, const std::vector<std::uint8_t> &input_data);
+latency_t latency(std::shared_ptr<input_t> &input);
 
 
 void init();
 
-std::shared_ptr<input_t> alloc(safe::mail_t mail);
+std::shared_ptr<input_t> alloc(safe::mail_t mail, std::shared_ptr<stats::session_t> stats);
 
 struct touch_port_t : public platf::touch_port_t {
   int env_width, env_height;
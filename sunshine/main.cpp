@@ -18,11 +18,13 @@
 
 #include "config.h"
 #include "confighttp.h"
+#include "fec.h"
 #include "httpcommon.h"
 #include "main.h"
 #include "nvhttp.h"
 #include "rtsp.h"
 #include "thread_pool.h"
+#include "trace.h"
 #include "upnp.h"
 #include "video.h"
 
@@ -187,7 +189,8 @@ int main(int argc, char *argv[]) {
     return fn->second(argv[0], config::sunshine.cmd.argc, config::sunshine.cmd.argv);
   }
 
-  task_pool.start(1);
+  // Input is injected from a single strand, the second thread keeps it from waiting behind a task that blocks
+  task_pool.start(2);
 
   bool shutdown_by_interrupt = false;
 
@@ -242,7 +245,9 @@ int main(int argc, char *argv[]) {
   }
 
   reed_solomon_init();
+  fec::init();
   input::init();
+  trace::enable(config::sunshine.trace);
   if(video::init()) {
     return 2;
   }
@@ -276,6 +281,19 @@ int main(int argc, char *argv[]) {
   task_pool.stop();
   task_pool.join();
 
+  constexpr std::string_view priority_names[] { "high"sv, "normal"sv, "low"sv };
+  for(int x = 0; x < util::PRIORITIES; ++x) {
+    auto stats = task_pool.delay_stats((util::priority_e)x);
+    if(!stats.tasks) {
+      continue;
+    }
+
+    BOOST_LOG(debug)
+      << "Task pool ["sv << priority_names[x] << "]: "sv << stats.tasks << " tasks waited "sv
+      << std::chrono::duration_cast<std::chrono::microseconds>(stats.total / stats.tasks).count() << "us on average, "sv
+      << std::chrono::duration_cast<std::chrono::microseconds>(stats.max).count() << "us at most"sv;
+  }
+
   return 0;
 }
 
@@ -31,22 +31,29 @@ int write_file(const char *path, const std::string_view &contents);
 
 std::uint16_t map_port(int port);
 
+namespace input {
+struct touch_port_t;
+} // namespace input
+
 namespace mail {
-#define MAIL(x) \
-  constexpr auto x = std::string_view { #x }
+enum id_e : std::size_t {
+  SHUTDOWN,
+  BROADCAST_SHUTDOWN,
+  TOUCH_PORT,
+  IDR, // Declared in video.h, next to video::idr_t
+};
+
+#define MAIL(x, id, P) \
+  constexpr auto x = safe::mail_id_t<P, id> {}
 
 extern safe::mail_t man;
 
 // Global mail
-MAIL(shutdown);
-MAIL(broadcast_shutdown);
-
-MAIL(video_packets);
-MAIL(audio_packets);
+MAIL(shutdown, SHUTDOWN, safe::signal_t);
+MAIL(broadcast_shutdown, BROADCAST_SHUTDOWN, safe::signal_t);
 
 // Local mail
-MAIL(touch_port);
-MAIL(idr);
+MAIL(touch_port, TOUCH_PORT, safe::event_t<input::touch_port_t>);
 #undef MAIL
 } // namespace mail
 
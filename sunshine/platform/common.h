@@ -6,13 +6,17 @@
 #define SUNSHINE_COMMON_H
 
 #include <bitset>
+#include <chrono>
 #include <filesystem>
+#include <functional>
 #include <mutex>
+#include <optional>
 #include <string>
 
 #include "sunshine/utility.h"
 
 struct sockaddr;
+struct sockaddr_storage;
 struct AVFrame;
 
 namespace platf {
@@ -220,6 +224,86 @@ public:
   virtual ~audio_control_t() = default;
 };
 
+struct batched_send_info_t {
+  // block_count blocks of block_size bytes each, stored back to back
+  const char *buffer;
+  std::size_t block_size;
+  std::size_t block_count;
+
+  std::uintptr_t native_socket;
+  const sockaddr *target;
+  int target_size;
+
+  // If set, the kernel holds the blocks back until then, see enable_txtime()
+  std::optional<std::chrono::steady_clock::time_point> send_time;
+};
+
+/**
+ * Send all blocks to the target with as few syscalls as the platform allows
+ * @return the number of syscalls made, or -1 if nothing was sent because batching isn't available
+ */
+int send_batch(batched_send_info_t &send_info);
+
+/**
+ * Allow batched_send_info_t::send_time to be used with this socket
+ * @return 0 on success
+ */
+int enable_txtime(std::uintptr_t native_socket);
+
+struct batched_recv_info_t {
+  // block_count buffers of block_size bytes each, stored back to back
+  char *buffer;
+  std::size_t block_size;
+  std::size_t block_count;
+
+  std::uintptr_t native_socket;
+
+  // block_count entries, filled in with the size and origin of each datagram received
+  std::size_t *sizes;
+  sockaddr_storage *sources;
+};
+
+/**
+ * Receive the datagrams already pending on the socket, up to block_count, without blocking
+ * @return the number of datagrams received, 0 if none were pending, or -1 with errno set on error
+ *         errno is ENOSYS if batching isn't available
+ */
+int recv_batch(batched_recv_info_t &recv_info);
+
+/**
+ * Sleeps until a socket is readable, another thread calls wake(), or a deadline passes
+ */
+class event_poll_t {
+public:
+  // Safe to call from any thread
+  virtual void wake() = 0;
+
+  /**
+   * @param deadline If empty, wait until the socket is readable or wake() is called
+   * @return -1 on error, otherwise 0
+   */
+  virtual int wait(std::optional<std::chrono::steady_clock::time_point> deadline) = 0;
+
+  virtual ~event_poll_t() = default;
+};
+
+/**
+ * @return nullptr if the platform can't wait on the socket and wake() at once
+ */
+std::unique_ptr<event_poll_t> event_poll(std::uintptr_t native_socket);
+
+// Stops watching the process when destroyed
+class process_watch_t {
+public:
+  virtual ~process_watch_t() = default;
+};
+
+/**
+ * Call on_exit from another thread as soon as the process exits, the process is not reaped
+ * @return nullptr if the platform can't watch the process, the caller has to poll it
+ */
+std::unique_ptr<process_watch_t> watch_process(std::int64_t pid, std::function<void()> &&on_exit);
+
 void freeInput(void *);
 
 using input_t = util::safe_ptr<void, freeInput>;
@@ -14,6 +14,8 @@
 #include "sunshine/platform/common.h"
 #include "sunshine/utility.h"
 
+#include "uinput.h"
+
 // Support older versions
 #ifndef REL_HWHEEL_HI_RES
 #define REL_HWHEEL_HI_RES 0x0c
@@ -129,6 +131,11 @@ public:
 
   ~input_raw_t() {
     clear();
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    BOOST_LOG(info)
+      << "uinput: "sv << stats.events << " events in "sv << stats.writes << " writes, "sv
+      << stats.writes / seconds << " writes per second"sv;
   }
 
   std::vector<std::pair<uinput_t, gamepad_state_t>> gamepads;
@@ -140,34 +147,39 @@ public:
   evdev_t mouse_dev;
 
   keyboard_t keyboard;
+
+  uinput::stats_t stats {};
+  std::chrono::steady_clock::time_point start { std::chrono::steady_clock::now() };
 };
 
 void abs_mouse(input_t &input, const touch_port_t &touch_port, float x, float y) {
-  auto touchscreen = ((input_raw_t *)input.get())->touch_input.get();
+  auto raw = (input_raw_t *)input.get();
+  uinput::batch_t touchscreen { raw->touch_input.get(), raw->stats };
 
   auto scaled_x = (int)std::lround((x + touch_port.offset_x) * ((float)target_touch_port.width / (float)touch_port.width));
   auto scaled_y = (int)std::lround((y + touch_port.offset_y) * ((float)target_touch_port.height / (float)touch_port.height));
 
-  libevdev_uinput_write_event(touchscreen, EV_ABS, ABS_X, scaled_x);
-  libevdev_uinput_write_event(touchscreen, EV_ABS, ABS_Y, scaled_y);
-  libevdev_uinput_write_event(touchscreen, EV_KEY, BTN_TOOL_FINGER, 1);
-  libevdev_uinput_write_event(touchscreen, EV_KEY, BTN_TOOL_FINGER, 0);
+  touchscreen.event(EV_ABS, ABS_X, scaled_x);
+  touchscreen.event(EV_ABS, ABS_Y, scaled_y);
+  touchscreen.event(EV_KEY, BTN_TOOL_FINGER, 1);
+  touchscreen.event(EV_KEY, BTN_TOOL_FINGER, 0);
 
-  libevdev_uinput_write_event(touchscreen, EV_SYN, SYN_REPORT, 0);
+  touchscreen.report();
 }
 
 void move_mouse(input_t &input, int deltaX, int deltaY) {
-  auto mouse = ((input_raw_t *)input.get())->mouse_input.get();
+  auto raw = (input_raw_t *)input.get();
+  uinput::batch_t mouse { raw->mouse_input.get(), raw->stats };
 
   if(deltaX) {
-    libevdev_uinput_write_event(mouse, EV_REL, REL_X, deltaX);
+    mouse.event(EV_REL, REL_X, deltaX);
   }
 
   if(deltaY) {
-    libevdev_uinput_write_event(mouse, EV_REL, REL_Y, deltaY);
+    mouse.event(EV_REL, REL_Y, deltaY);
   }
 
-  libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
+  mouse.report();
 }
 
 void button_mouse(input_t &input, int button, bool release) {
@@ -195,19 +207,23 @@ void button_mouse(input_t &input, int button, bool release) {
     scan     = 90005;
   }
 
-  auto mouse = ((input_raw_t *)input.get())->mouse_input.get();
-  libevdev_uinput_write_event(mouse, EV_MSC, MSC_SCAN, scan);
-  libevdev_uinput_write_event(mouse, EV_KEY, btn_type, release ? 0 : 1);
-  libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
+  auto raw = (input_raw_t *)input.get();
+  uinput::batch_t mouse { raw->mouse_input.get(), raw->stats };
+
+  mouse.event(EV_MSC, MSC_SCAN, scan);
+  mouse.event(EV_KEY, btn_type, release ? 0 : 1);
+  mouse.report();
 }
 
 void scroll(input_t &input, int high_res_distance) {
   int distance = high_res_distance / 120;
 
-  auto mouse = ((input_raw_t *)input.get())->mouse_input.get();
-  libevdev_uinput_write_event(mouse, EV_REL, REL_WHEEL, distance);
-  libevdev_uinput_write_event(mouse, EV_REL, REL_WHEEL_HI_RES, high_res_distance);
-  libevdev_uinput_write_event(mouse, EV_SYN, SYN_REPORT, 0);
+  auto raw = (input_raw_t *)input.get();
+  uinput::batch_t mouse { raw->mouse_input.get(), raw->stats };
+
+  mouse.event(EV_REL, REL_WHEEL, distance);
+  mouse.event(EV_REL, REL_WHEEL_HI_RES, high_res_distance);
+  mouse.report();
 }
 
 uint16_t keysym(uint16_t modcode) {
@@ -346,8 +362,10 @@ void free_gamepad(input_t &input, int nr) {
 }
 
 void gamepad(input_t &input, int nr, const gamepad_state_t &gamepad_state) {
-  TUPLE_2D_REF(uinput, gamepad_state_old, ((input_raw_t *)input.get())->gamepads[nr]);
+  auto raw = (input_raw_t *)input.get();
+  TUPLE_2D_REF(uinput, gamepad_state_old, raw->gamepads[nr]);
 
+  uinput::batch_t batch { uinput.get(), raw->stats };
 
   auto bf     = gamepad_state.buttonFlags ^ gamepad_state_old.buttonFlags;
   auto bf_new = gamepad_state.buttonFlags;
@@ -357,54 +375,54 @@ void gamepad(input_t &input, int nr, const gamepad_state_t &gamepad_state) {
     if((DPAD_UP | DPAD_DOWN) & bf) {
       int button_state = bf_new & DPAD_UP ? -1 : (bf_new & DPAD_DOWN ? 1 : 0);
 
-      libevdev_uinput_write_event(uinput.get(), EV_ABS, ABS_HAT0Y, button_state);
+      batch.event(EV_ABS, ABS_HAT0Y, button_state);
     }
 
     if((DPAD_LEFT | DPAD_RIGHT) & bf) {
       int button_state = bf_new & DPAD_LEFT ? -1 : (bf_new & DPAD_RIGHT ? 1 : 0);
 
-      libevdev_uinput_write_event(uinput.get(), EV_ABS, ABS_HAT0X, button_state);
+      batch.event(EV_ABS, ABS_HAT0X, button_state);
     }
 
-    if(START & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_START, bf_new & START ? 1 : 0);
-    if(BACK & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_SELECT, bf_new & BACK ? 1 : 0);
-    if(LEFT_STICK & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_THUMBL, bf_new & LEFT_STICK ? 1 : 0);
-    if(RIGHT_STICK & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_THUMBR, bf_new & RIGHT_STICK ? 1 : 0);
-    if(LEFT_BUTTON & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_TL, bf_new & LEFT_BUTTON ? 1 : 0);
-    if(RIGHT_BUTTON & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_TR, bf_new & RIGHT_BUTTON ? 1 : 0);
-    if(HOME & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_MODE, bf_new & HOME ? 1 : 0);
-    if(A & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_SOUTH, bf_new & A ? 1 : 0);
-    if(B & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_EAST, bf_new & B ? 1 : 0);
-    if(X & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_NORTH, bf_new & X ? 1 : 0);
-    if(Y & bf) libevdev_uinput_write_event(uinput.get(), EV_KEY, BTN_WEST, bf_new & Y ? 1 : 0);
+    if(START & bf) batch.event(EV_KEY, BTN_START, bf_new & START ? 1 : 0);
+    if(BACK & bf) batch.event(EV_KEY, BTN_SELECT, bf_new & BACK ? 1 : 0);
+    if(LEFT_STICK & bf) batch.event(EV_KEY, BTN_THUMBL, bf_new & LEFT_STICK ? 1 : 0);
+    if(RIGHT_STICK & bf) batch.event(EV_KEY, BTN_THUMBR, bf_new & RIGHT_STICK ? 1 : 0);
+    if(LEFT_BUTTON & bf) batch.event(EV_KEY, BTN_TL, bf_new & LEFT_BUTTON ? 1 : 0);
+    if(RIGHT_BUTTON & bf) batch.event(EV_KEY, BTN_TR, bf_new & RIGHT_BUTTON ? 1 : 0);
+    if(HOME & bf) batch.event(EV_KEY, BTN_MODE, bf_new & HOME ? 1 : 0);
+    if(A & bf) batch.event(EV_KEY, BTN_SOUTH, bf_new & A ? 1 : 0);
+    if(B & bf) batch.event(EV_KEY, BTN_EAST, bf_new & B ? 1 : 0);
+    if(X & bf) batch.event(EV_KEY, BTN_NORTH, bf_new & X ? 1 : 0);
+    if(Y & bf) batch.event(EV_KEY, BTN_WEST, bf_new & Y ? 1 : 0);
   }
 
   if(gamepad_state_old.lt != gamepad_state.lt) {
-    libevdev_uinput_write_event(uinput.get(), EV_ABS, ABS_Z, gamepad_state.lt);
+    batch.event(EV_ABS, ABS_Z, gamepad_state.lt);
   }
 
   if(gamepad_state_old.rt != gamepad_state.rt) {
-    libevdev_uinput_write_event(uinput.get(), EV_ABS, ABS_RZ, gamepad_state.rt);
+    batch.event(EV_ABS, ABS_RZ, gamepad_state.rt);
   }
 
   if(gamepad_state_old.lsX != gamepad_state.lsX) {
-    libevdev_uinput_write_event(uinput.get(), EV_ABS, ABS_X, gamepad_state.lsX);
+    batch.event(EV_ABS, ABS_X, gamepad_state.lsX);
   }
 
   if(gamepad_state_old.lsY != gamepad_state.lsY) {
-    libevdev_uinput_write_event(uinput.get(), EV_ABS, ABS_Y, -gamepad_state.lsY);
+    batch.event(EV_ABS, ABS_Y, -gamepad_state.lsY);
   }
 
   if(gamepad_state_old.rsX != gamepad_state.rsX) {
-    libevdev_uinput_write_event(uinput.get(), EV_ABS, ABS_RX, gamepad_state.rsX);
+    batch.event(EV_ABS, ABS_RX, gamepad_state.rsX);
   }
 
   if(gamepad_state_old.rsY != gamepad_state.rsY) {
-    libevdev_uinput_write_event(uinput.get(), EV_ABS, ABS_RY, -gamepad_state.rsY);
+    batch.event(EV_ABS, ABS_RY, -gamepad_state.rsY);
   }
 
   gamepad_state_old = gamepad_state;
-  libevdev_uinput_write_event(uinput.get(), EV_SYN, SYN_REPORT, 0);
+  batch.report();
 }
 
 evdev_t mouse() {
@@ -2,15 +2,32 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
+#include <linux/net_tstamp.h>
+#include <netinet/udp.h>
+#include <poll.h>
 #include <pwd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <thread>
 
 #include "misc.h"
 #include "sunshine/main.h"
 #include "sunshine/platform/common.h"
 
+// Support older versions
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
 #ifdef __GNUC__
 #define SUNSHINE_GNUC_EXTENSION __extension__
 #else
@@ -93,6 +110,359 @@ std::string get_mac_address(const std::string_view &address) {
   BOOST_LOG(warning) << "Unable to find MAC address for "sv << address;
   return "00:00:00:00:00:00"s;
 }
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+// The kernel refuses to segment more than 64 datagrams or a single UDP datagram worth of data at once
+constexpr std::size_t MAX_GSO_SEGMENTS = 64;
+constexpr std::size_t MAX_GSO_SIZE     = 65507;
+
+// Cleared the first time the kernel or the network device refuses to segment for us
+static std::atomic<bool> gso_supported { true };
+
+// Appends the control messages shared by every datagram of a batch
+static void append_cmsgs(msghdr &msg, batched_send_info_t &send_info, std::uint16_t segment_size) {
+  auto cm = (cmsghdr *)msg.msg_control;
+
+  std::size_t controllen = 0;
+  if(segment_size) {
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type  = UDP_SEGMENT;
+    cm->cmsg_len   = CMSG_LEN(sizeof(std::uint16_t));
+    std::memcpy(CMSG_DATA(cm), &segment_size, sizeof(segment_size));
+
+    controllen += CMSG_SPACE(sizeof(std::uint16_t));
+    cm = (cmsghdr *)((char *)cm + CMSG_SPACE(sizeof(std::uint16_t)));
+  }
+
+  if(send_info.send_time) {
+    // std::chrono::steady_clock is CLOCK_MONOTONIC, the clock enable_txtime() selects
+    std::uint64_t txtime = std::chrono::duration_cast<std::chrono::nanoseconds>(send_info.send_time->time_since_epoch()).count();
+
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type  = SCM_TXTIME;
+    cm->cmsg_len   = CMSG_LEN(sizeof(std::uint64_t));
+    std::memcpy(CMSG_DATA(cm), &txtime, sizeof(txtime));
+
+    controllen += CMSG_SPACE(sizeof(std::uint64_t));
+  }
+
+  msg.msg_controllen = controllen;
+  if(!controllen) {
+    msg.msg_control = nullptr;
+  }
+}
+
+union cmsg_buf_t {
+  char buf[CMSG_SPACE(sizeof(std::uint16_t)) + CMSG_SPACE(sizeof(std::uint64_t))];
+  cmsghdr alignment;
+};
+
+static int send_batch_gso(batched_send_info_t &send_info) {
+  auto segments_max = std::min(MAX_GSO_SEGMENTS, MAX_GSO_SIZE / send_info.block_size);
+  if(segments_max < 2) {
+    return -1;
+  }
+
+  cmsg_buf_t cmsg_buf;
+
+  int syscalls = 0;
+  for(std::size_t block = 0; block < send_info.block_count;) {
+    auto segments = std::min(segments_max, send_info.block_count - block);
+
+    iovec iov {
+      (void *)(send_info.buffer + block * send_info.block_size),
+      segments * send_info.block_size,
+    };
+
+    msghdr msg {};
+    msg.msg_name    = (void *)send_info.target;
+    msg.msg_namelen = send_info.target_size;
+    msg.msg_iov     = &iov;
+    msg.msg_iovlen  = 1;
+    msg.msg_control = cmsg_buf.buf;
+
+    // A lone datagram doesn't need segmentation
+    append_cmsgs(msg, send_info, segments > 1 ? send_info.block_size : 0);
+
+    ++syscalls;
+    auto bytes = sendmsg(send_info.native_socket, &msg, 0);
+    if(bytes < 0) {
+      if(block == 0 && (errno == EINVAL || errno == EIO || errno == EOPNOTSUPP || errno == ENOPROTOOPT)) {
+        BOOST_LOG(info) << "UDP segmentation offload unavailable, falling back to sendmmsg()"sv;
+        gso_supported = false;
+
+        return -1;
+      }
+
+      BOOST_LOG(warning) << "Couldn't send batch of "sv << segments << " datagrams: "sv << strerror(errno);
+      return syscalls;
+    }
+
+    block += segments;
+  }
+
+  return syscalls;
+}
+
+static int send_batch_mmsg(batched_send_info_t &send_info) {
+  constexpr std::size_t MAX_MESSAGES = 64;
+
+  iovec iovs[MAX_MESSAGES];
+  mmsghdr msgs[MAX_MESSAGES];
+  cmsg_buf_t cmsg_bufs[MAX_MESSAGES];
+
+  int syscalls = 0;
+  for(std::size_t block = 0; block < send_info.block_count;) {
+    auto count = std::min(MAX_MESSAGES, send_info.block_count - block);
+
+    for(std::size_t x = 0; x < count; ++x) {
+      iovs[x] = iovec {
+        (void *)(send_info.buffer + (block + x) * send_info.block_size),
+        send_info.block_size,
+      };
+
+      msgs[x]                     = mmsghdr {};
+      msgs[x].msg_hdr.msg_name    = (void *)send_info.target;
+      msgs[x].msg_hdr.msg_namelen = send_info.target_size;
+      msgs[x].msg_hdr.msg_iov     = &iovs[x];
+      msgs[x].msg_hdr.msg_iovlen  = 1;
+      msgs[x].msg_hdr.msg_control = cmsg_bufs[x].buf;
+
+      append_cmsgs(msgs[x].msg_hdr, send_info, 0);
+    }
+
+    ++syscalls;
+    auto sent = sendmmsg(send_info.native_socket, msgs, count, 0);
+    if(sent <= 0) {
+      if(block == 0 && errno == ENOSYS) {
+        return -1;
+      }
+
+      BOOST_LOG(warning) << "Couldn't send batch of "sv << count << " datagrams: "sv << strerror(errno);
+      return syscalls;
+    }
+
+    block += sent;
+  }
+
+  return syscalls;
+}
+
+int send_batch(batched_send_info_t &send_info) {
+  if(gso_supported.load(std::memory_order_relaxed)) {
+    auto syscalls = send_batch_gso(send_info);
+    if(syscalls >= 0) {
+      return syscalls;
+    }
+  }
+
+  return send_batch_mmsg(send_info);
+}
+
+int recv_batch(batched_recv_info_t &recv_info) {
+  constexpr std::size_t MAX_MESSAGES = 64;
+
+  iovec iovs[MAX_MESSAGES];
+  mmsghdr msgs[MAX_MESSAGES];
+
+  auto count = std::min(MAX_MESSAGES, recv_info.block_count);
+  for(std::size_t x = 0; x < count; ++x) {
+    iovs[x] = iovec {
+      recv_info.buffer + x * recv_info.block_size,
+      recv_info.block_size,
+    };
+
+    msgs[x]                     = mmsghdr {};
+    msgs[x].msg_hdr.msg_name    = &recv_info.sources[x];
+    msgs[x].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+    msgs[x].msg_hdr.msg_iov     = &iovs[x];
+    msgs[x].msg_hdr.msg_iovlen  = 1;
+  }
+
+  auto received = recvmmsg(recv_info.native_socket, msgs, count, MSG_DONTWAIT, nullptr);
+  if(received < 0) {
+    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    }
+
+    return -1;
+  }
+
+  for(int x = 0; x < received; ++x) {
+    recv_info.sizes[x] = msgs[x].msg_len;
+  }
+
+  return received;
+}
+
+class epoll_t : public event_poll_t {
+public:
+  ~epoll_t() override {
+    for(auto fd : { epoll_fd, event_fd, timer_fd }) {
+      if(fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  int init(std::uintptr_t native_socket) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if(epoll_fd < 0 || event_fd < 0 || timer_fd < 0) {
+      BOOST_LOG(error) << "Couldn't create epoll, eventfd or timerfd: "sv << strerror(errno);
+      return -1;
+    }
+
+    for(int fd : { (int)native_socket, event_fd, timer_fd }) {
+      epoll_event event {};
+      event.events  = EPOLLIN;
+      event.data.fd = fd;
+
+      if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+        BOOST_LOG(error) << "Couldn't add ["sv << fd << "] to epoll: "sv << strerror(errno);
+        return -1;
+      }
+    }
+
+    return 0;
+  }
+
+  void wake() override {
+    std::uint64_t one = 1;
+    write(event_fd, &one, sizeof(one));
+  }
+
+  int wait(std::optional<std::chrono::steady_clock::time_point> deadline) override {
+    // An all zero itimerspec disarms the timer
+    itimerspec spec {};
+    if(deadline) {
+      // std::chrono::steady_clock is CLOCK_MONOTONIC
+      auto ns = std::max<std::int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(deadline->time_since_epoch()).count());
+
+      spec.it_value.tv_sec  = ns / 1000000000;
+      spec.it_value.tv_nsec = ns % 1000000000;
+    }
+
+    if(timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr)) {
+      return -1;
+    }
+
+    std::array<epoll_event, 3> events;
+    int count = epoll_wait(epoll_fd, events.data(), events.size(), -1);
+    if(count < 0) {
+      return errno == EINTR ? 0 : -1;
+    }
+
+    // The socket is drained by the caller, the counters are reset here
+    for(int x = 0; x < count; ++x) {
+      auto fd = events[x].data.fd;
+      if(fd == event_fd || fd == timer_fd) {
+        std::uint64_t expirations;
+        read(fd, &expirations, sizeof(expirations));
+      }
+    }
+
+    return 0;
+  }
+
+  int epoll_fd = -1;
+  int event_fd = -1;
+  int timer_fd = -1;
+};
+
+std::unique_ptr<event_poll_t> event_poll(std::uintptr_t native_socket) {
+  auto poll = std::make_unique<epoll_t>();
+  if(poll->init(native_socket)) {
+    return nullptr;
+  }
+
+  return poll;
+}
+
+class pidfd_watch_t : public process_watch_t {
+public:
+  ~pidfd_watch_t() override {
+    if(thread.joinable()) {
+      std::uint64_t one = 1;
+      write(stop_fd, &one, sizeof(one));
+
+      thread.join();
+    }
+
+    for(auto fd : { pid_fd, stop_fd }) {
+      if(fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  int init(std::int64_t pid, std::function<void()> &&on_exit) {
+    // Linux 5.3 and later
+    pid_fd = syscall(SYS_pidfd_open, (pid_t)pid, 0);
+    if(pid_fd < 0) {
+      BOOST_LOG(warning) << "Couldn't open pidfd for ["sv << pid << "]: "sv << strerror(errno);
+      return -1;
+    }
+
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    if(stop_fd < 0) {
+      BOOST_LOG(warning) << "Couldn't create eventfd: "sv << strerror(errno);
+      return -1;
+    }
+
+    thread = std::thread { [this, on_exit = std::move(on_exit)]() {
+      // A pidfd becomes readable once the process exits, it can still be reaped afterwards
+      std::array<pollfd, 2> fds {
+        pollfd { pid_fd, POLLIN, 0 },
+        pollfd { stop_fd, POLLIN, 0 }
+      };
+
+      while(poll(fds.data(), fds.size(), -1) < 0) {
+        if(errno != EINTR) {
+          BOOST_LOG(error) << "Couldn't wait for the process to exit: "sv << strerror(errno);
+          return;
+        }
+      }
+
+      if(fds[0].revents & POLLIN) {
+        on_exit();
+      }
+    } };
+
+    return 0;
+  }
+
+  int pid_fd  = -1;
+  int stop_fd = -1;
+
+  std::thread thread;
+};
+
+std::unique_ptr<process_watch_t> watch_process(std::int64_t pid, std::function<void()> &&on_exit) {
+  auto watch = std::make_unique<pidfd_watch_t>();
+  if(watch->init(pid, std::move(on_exit))) {
+    return nullptr;
+  }
+
+  return watch;
+}
+
+int enable_txtime(std::uintptr_t native_socket) {
+  sock_txtime txtime_opt {};
+  txtime_opt.clockid = CLOCK_MONOTONIC;
+
+  if(setsockopt(native_socket, SOL_SOCKET, SO_TXTIME, &txtime_opt, sizeof(txtime_opt))) {
+    BOOST_LOG(warning) << "Couldn't enable SO_TXTIME: "sv << strerror(errno);
+    return -1;
+  }
+
+  return 0;
+}
 } // namespace platf
 
 namespace dyn {
@@ -0,0 +1,78 @@
+#ifndef SUNSHINE_PLATFORM_LINUX_UINPUT_H
+#define SUNSHINE_PLATFORM_LINUX_UINPUT_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <unistd.h>
+
+#include <libevdev/libevdev-uinput.h>
+
+namespace platf::uinput {
+// Every write() issued to the uinput devices, and the events they carried
+struct stats_t {
+  std::atomic<std::uint64_t> writes;
+  std::atomic<std::uint64_t> events;
+};
+
+/**
+ * Collects the events of a single report, so they reach the kernel with a single write()
+ * libevdev_uinput_write_event() costs a syscall for every axis, button and SYN_REPORT.
+ */
+class batch_t {
+public:
+  // A full gamepad report: both hats, eleven buttons, six axes and SYN_REPORT
+  static constexpr std::size_t MAX_EVENTS = 32;
+
+  batch_t(libevdev_uinput *uinput, stats_t &stats) : _uinput { uinput }, _stats { stats }, _events {}, _size { 0 } {}
+
+  void event(int type, int code, int value) {
+    // The kernel only acts on the events once SYN_REPORT arrives, a partial write is harmless
+    if(_size == _events.size()) {
+      _write();
+    }
+
+    auto &ev = _events[_size++];
+
+    ev.type  = type;
+    ev.code  = code;
+    ev.value = value;
+  }
+
+  /**
+   * Terminate the report with SYN_REPORT and write it out
+   * @return -1 on failure, 0 on success
+   */
+  int report() {
+    event(EV_SYN, SYN_REPORT, 0);
+
+    return _write();
+  }
+
+private:
+  int _write() {
+    auto size = _size;
+    _size     = 0;
+
+    ++_stats.writes;
+    _stats.events += size;
+
+    auto bytes = sizeof(input_event) * size;
+    if(::write(libevdev_uinput_get_fd(_uinput), _events.data(), bytes) != (ssize_t)bytes) {
+      return -1;
+    }
+
+    return 0;
+  }
+
+  libevdev_uinput *_uinput;
+  stats_t &_stats;
+
+  // Zero timestamps, the kernel fills them in just like it does for libevdev_uinput_write_event()
+  std::array<input_event, MAX_EVENTS> _events;
+  std::size_t _size;
+};
+} // namespace platf::uinput
+
+#endif
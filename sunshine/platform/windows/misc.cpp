@@ -1,3 +1,4 @@
+#include <cerrno>
 #include <filesystem>
 #include <iomanip>
 #include <sstream>
@@ -67,6 +68,31 @@ adapteraddrs_t get_adapteraddrs() {
   return info;
 }
 
+int send_batch(batched_send_info_t &send_info) {
+  // Let the caller send the blocks one at a time
+  return -1;
+}
+
+int enable_txtime(std::uintptr_t native_socket) {
+  return -1;
+}
+
+int recv_batch(batched_recv_info_t &recv_info) {
+  // Let the caller receive the datagrams one at a time
+  errno = ENOSYS;
+  return -1;
+}
+
+std::unique_ptr<event_poll_t> event_poll(std::uintptr_t native_socket) {
+  // Let the caller poll with a timeout
+  return nullptr;
+}
+
+std::unique_ptr<process_watch_t> watch_process(std::int64_t pid, std::function<void()> &&on_exit) {
+  // Let the caller poll the process
+  return nullptr;
+}
+
 std::string get_mac_address(const std::string_view &address) {
   adapteraddrs_t info = get_adapteraddrs();
   for(auto adapter_pos = info.get(); adapter_pos != nullptr; adapter_pos = adapter_pos->Next) {
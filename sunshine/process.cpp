@@ -22,6 +22,19 @@ namespace pt = boost::property_tree;
 
 proc_t proc;
 
+static std::mutex exit_lock;
+static std::function<void()> exit_cb;
+
+// The control thread asks whether the process is watched while nvhttp threads start and stop it,
+// guards what watched() reads: _app_id, placebo and _watch
+static std::mutex watch_lock;
+
+void on_exit(std::function<void()> &&callback) {
+  std::lock_guard lg { exit_lock };
+
+  exit_cb = std::move(callback);
+}
+
 void process_end(bp::child &proc, bp::group &proc_handle) {
   if(!proc.running()) {
     return;
@@ -59,7 +72,10 @@ int proc_t::execute(int app_id) {
   // Ensure starting from a clean slate
   terminate();
 
-  _app_id    = app_id;
+  {
+    std::lock_guard lg { watch_lock };
+    _app_id = app_id;
+  }
   auto &proc = _apps[app_id];
 
   _undo_begin = std::begin(proc.prep_cmds);
@@ -108,6 +124,7 @@ int proc_t::execute(int app_id) {
 
   BOOST_LOG(info) << "Executing: ["sv << proc.cmd << ']';
   if(proc.cmd.empty()) {
+    std::lock_guard lg { watch_lock };
     placebo = true;
   }
   else if(proc.output.empty() || proc.output == "null"sv) {
@@ -122,6 +139,20 @@ int proc_t::execute(int app_id) {
     return -1;
   }
 
+  if(!placebo) {
+    auto watch = platf::watch_process(_process.id(), []() {
+      BOOST_LOG(debug) << "Process exited"sv;
+
+      std::lock_guard lg { exit_lock };
+      if(exit_cb) {
+        exit_cb();
+      }
+    });
+
+    std::lock_guard lg { watch_lock };
+    _watch = std::move(watch);
+  }
+
   fg.disable();
 
   return 0;
@@ -135,13 +166,33 @@ int proc_t::running() {
   return -1;
 }
 
+bool proc_t::watched() const {
+  std::lock_guard lg { watch_lock };
+
+  return _app_id == -1 || placebo || _watch;
+}
+
 void proc_t::terminate() {
   std::error_code ec;
 
+  // Stop watching before the process is killed, that exit was asked for
+  std::unique_ptr<platf::process_watch_t> watch;
+  {
+    std::lock_guard lg { watch_lock };
+
+    watch   = std::move(_watch);
+    placebo = false;
+  }
+
+  // Joins the watching thread, which may be waiting on exit_lock
+  watch.reset();
+
   // Ensure child process is terminated
-  placebo = false;
   process_end(_process, _process_handle);
-  _app_id = -1;
+  {
+    std::lock_guard lg { watch_lock };
+    _app_id = -1;
+  }
 
   if(ec) {
     BOOST_LOG(fatal) << "System: "sv << ec.message();
@@ -14,6 +14,7 @@
 
 #include <boost/process.hpp>
 
+#include "platform/common.h"
 #include "utility.h"
 
 namespace proc {
@@ -72,6 +73,12 @@ public:
    */
   int running();
 
+  /**
+   * @return false if the current process may exit without calling the on_exit callback,
+   *         then running() has to be polled
+   */
+  bool watched() const;
+
   ~proc_t();
 
   const std::vector<ctx_t> &get_apps() const;
@@ -91,11 +98,18 @@ private:
   boost::process::child _process;
   boost::process::group _process_handle;
 
+  std::unique_ptr<platf::process_watch_t> _watch;
+
   file_t _pipe;
   std::vector<cmd_t>::const_iterator _undo_it;
   std::vector<cmd_t>::const_iterator _undo_begin;
 };
 
+/**
+ * Called from another thread when the process launched by proc exits on its own
+ */
+void on_exit(std::function<void()> &&callback);
+
 void refresh(const std::string &file_name);
 std::optional<proc::proc_t> parse(const std::string &file_name);
 
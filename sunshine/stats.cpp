@@ -0,0 +1,186 @@
+//
+// Per session counters, exported in the Prometheus text format
+//
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "stats.h"
+
+namespace stats {
+using namespace std::literals;
+
+struct metric_t {
+  std::string_view name;
+  std::string_view help;
+};
+
+static constexpr std::array<metric_t, MAX_COUNTERS> counters {
+  metric_t { "sunshine_frames_captured_total"sv, "Captured images converted for the encoder"sv },
+  metric_t { "sunshine_frames_encoded_total"sv, "Video frames produced by the encoder"sv },
+  metric_t { "sunshine_idr_frames_total"sv, "Key frames produced by the encoder"sv },
+  metric_t { "sunshine_idr_requests_total"sv, "Reference frame invalidations requested by the client"sv },
+  metric_t { "sunshine_video_bytes_total"sv, "Bytes of video packets sent, including parity"sv },
+  metric_t { "sunshine_video_packets_total"sv, "Video packets sent, including parity"sv },
+  metric_t { "sunshine_fec_shards_total"sv, "Video parity packets sent"sv },
+  metric_t { "sunshine_video_drops_total"sv, "Frames dropped because the video worker fell behind"sv },
+  metric_t { "sunshine_pacing_overruns_total"sv, "Frames sent without pacing because the next frame was ready"sv },
+  metric_t { "sunshine_loss_reports_total"sv, "Loss reports received from the client"sv },
+  metric_t { "sunshine_frames_lost_total"sv, "Frames the client reported lost"sv },
+  metric_t { "sunshine_input_events_total"sv, "Input packets injected"sv },
+  metric_t { "sunshine_audio_packets_total"sv, "Audio packets sent, including parity"sv },
+  metric_t { "sunshine_audio_bytes_total"sv, "Bytes of audio packets sent, including parity"sv },
+  metric_t { "sunshine_audio_underruns_total"sv, "Times the microphone had no samples ready"sv },
+};
+
+static constexpr std::array<metric_t, MAX_GAUGES> gauges {
+  metric_t { "sunshine_video_queue_depth"sv, "Video packets waiting for the worker of the session"sv },
+  metric_t { "sunshine_audio_queue_depth"sv, "Audio packets waiting for the worker of the session"sv },
+};
+
+static constexpr std::array<metric_t, MAX_HISTOGRAMS> histograms {
+  metric_t { "sunshine_convert_seconds"sv, "Time to convert a captured image for the encoder"sv },
+  metric_t { "sunshine_encode_seconds"sv, "Time to encode a frame"sv },
+  metric_t { "sunshine_send_seconds"sv, "Time to packetize, protect and send a frame"sv },
+  metric_t { "sunshine_pacing_seconds"sv, "Time the packets of a frame were spread over"sv },
+  metric_t { "sunshine_input_latency_seconds"sv, "Time from receiving an input packet to injecting it"sv },
+};
+
+static std::mutex registry_lock;
+static std::vector<std::weak_ptr<session_t>> registry;
+static std::uint32_t next_id = 1;
+
+// Threads are spread over the shards as they first touch a counter
+static std::atomic<std::size_t> next_shard;
+
+session_t::shard_t &session_t::_shard() {
+  static thread_local auto shard = next_shard++ % SHARDS;
+
+  return _shards[shard];
+}
+
+void session_t::observe(histogram_e histogram, std::chrono::nanoseconds duration) {
+  auto &raw = _shard().histograms[histogram];
+
+  std::size_t bucket = 0;
+  while(bucket < BUCKETS.size() && duration > BUCKETS[bucket]) {
+    ++bucket;
+  }
+
+  raw.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  raw.sum.fetch_add(duration.count(), std::memory_order_relaxed);
+}
+
+session_t::snapshot_t session_t::snapshot() const {
+  snapshot_t snapshot {};
+
+  for(auto &shard : _shards) {
+    for(int x = 0; x < MAX_COUNTERS; ++x) {
+      snapshot.counters[x] += shard.counters[x].load(std::memory_order_relaxed);
+    }
+
+    for(int x = 0; x < MAX_HISTOGRAMS; ++x) {
+      auto &raw       = shard.histograms[x];
+      auto &histogram = snapshot.histograms[x];
+
+      for(std::size_t y = 0; y < raw.buckets.size(); ++y) {
+        histogram.buckets[y] += raw.buckets[y].load(std::memory_order_relaxed);
+      }
+      histogram.sum += std::chrono::nanoseconds { raw.sum.load(std::memory_order_relaxed) };
+    }
+  }
+
+  for(int x = 0; x < MAX_GAUGES; ++x) {
+    snapshot.gauges[x] = _gauges[x].load(std::memory_order_relaxed);
+  }
+
+  return snapshot;
+}
+
+std::shared_ptr<session_t> alloc() {
+  std::lock_guard lg { registry_lock };
+
+  auto session = std::make_shared<session_t>(next_id++);
+
+  // Forget the sessions that ended in the meantime
+  registry.erase(std::remove_if(std::begin(registry), std::end(registry), [](auto &session) {
+    return session.expired();
+  }),
+    std::end(registry));
+
+  registry.emplace_back(session);
+
+  return session;
+}
+
+std::string scrape() {
+  std::vector<std::pair<std::uint32_t, session_t::snapshot_t>> snapshots;
+  {
+    std::lock_guard lg { registry_lock };
+
+    for(auto &weak : registry) {
+      if(auto session = weak.lock()) {
+        snapshots.emplace_back(session->id, session->snapshot());
+      }
+    }
+  }
+
+  std::ostringstream out;
+  out.precision(9);
+
+  auto header = [&](const metric_t &metric, std::string_view type) {
+    out << "# HELP "sv << metric.name << ' ' << metric.help << '\n'
+        << "# TYPE "sv << metric.name << ' ' << type << '\n';
+  };
+
+  out << "# HELP sunshine_sessions Sessions currently streaming\n"sv
+      << "# TYPE sunshine_sessions gauge\n"sv
+      << "sunshine_sessions "sv << snapshots.size() << '\n';
+
+  for(int x = 0; x < MAX_COUNTERS; ++x) {
+    header(counters[x], "counter"sv);
+    for(auto &[id, snapshot] : snapshots) {
+      out << counters[x].name << "{session=\""sv << id << "\"} "sv << snapshot.counters[x] << '\n';
+    }
+  }
+
+  for(int x = 0; x < MAX_GAUGES; ++x) {
+    header(gauges[x], "gauge"sv);
+    for(auto &[id, snapshot] : snapshots) {
+      out << gauges[x].name << "{session=\""sv << id << "\"} "sv << snapshot.gauges[x] << '\n';
+    }
+  }
+
+  for(int x = 0; x < MAX_HISTOGRAMS; ++x) {
+    auto name = histograms[x].name;
+
+    header(histograms[x], "histogram"sv);
+    for(auto &[id, snapshot] : snapshots) {
+      auto &histogram = snapshot.histograms[x];
+
+      // Prometheus buckets are cumulative
+      std::uint64_t count = 0;
+      for(std::size_t y = 0; y < histogram.buckets.size(); ++y) {
+        count += histogram.buckets[y];
+
+        out << name << "_bucket{session=\""sv << id << "\",le=\""sv;
+        if(y < session_t::BUCKETS.size()) {
+          out << std::chrono::duration<double>(session_t::BUCKETS[y]).count();
+        }
+        else {
+          out << "+Inf"sv;
+        }
+        out << "\"} "sv << count << '\n';
+      }
+
+      out << name << "_sum{session=\""sv << id << "\"} "sv << std::chrono::duration<double>(histogram.sum).count() << '\n'
+          << name << "_count{session=\""sv << id << "\"} "sv << count << '\n';
+    }
+  }
+
+  return out.str();
+}
+} // namespace stats
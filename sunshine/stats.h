@@ -0,0 +1,126 @@
+#ifndef SUNSHINE_STATS_H
+#define SUNSHINE_STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace stats {
+enum counter_e : int {
+  FRAMES_CAPTURED, // Captured images converted for the encoder
+  FRAMES_ENCODED,
+  IDR_FRAMES,      // Key frames, requested or periodic
+  IDR_REQUESTS,    // Reference frame invalidations sent by the client
+  VIDEO_BYTES,
+  VIDEO_PACKETS,   // Data and parity shards
+  FEC_SHARDS,      // Parity shards only
+  VIDEO_DROPS,     // Frames the video worker had no room for
+  PACING_OVERRUNS, // Frames flushed unpaced, the next frame of their session was ready
+  LOSS_REPORTS,
+  FRAMES_LOST,     // As reported by the client
+  INPUT_EVENTS,
+  AUDIO_PACKETS,
+  AUDIO_BYTES,
+  AUDIO_UNDERRUNS, // The microphone had no samples ready in time
+  MAX_COUNTERS
+};
+
+enum gauge_e : int {
+  VIDEO_QUEUE_DEPTH, // Packets waiting behind the last one a video worker picked up
+  AUDIO_QUEUE_DEPTH,
+  MAX_GAUGES
+};
+
+enum histogram_e : int {
+  CONVERT_TIME,
+  ENCODE_TIME,
+  SEND_TIME,     // Packetizing, protecting and sending a frame
+  PACING_DELAY,  // From releasing the first packet of a frame to releasing the last
+  INPUT_LATENCY, // From receiving an input packet to injecting it
+  MAX_HISTOGRAMS
+};
+
+/**
+ * The counters of a single session
+ *
+ * Hot paths only touch the shard of their own thread with relaxed atomics,
+ * the shards are summed up when someone scrapes.
+ */
+class session_t {
+public:
+  static constexpr std::size_t SHARDS = 8;
+
+  // Upper bounds of the histogram buckets, a last bucket takes everything above
+  static constexpr std::array<std::chrono::nanoseconds, 10> BUCKETS {
+    std::chrono::microseconds { 100 },
+    std::chrono::microseconds { 250 },
+    std::chrono::microseconds { 500 },
+    std::chrono::milliseconds { 1 },
+    std::chrono::microseconds { 2500 },
+    std::chrono::milliseconds { 5 },
+    std::chrono::milliseconds { 10 },
+    std::chrono::milliseconds { 25 },
+    std::chrono::milliseconds { 50 },
+    std::chrono::milliseconds { 100 },
+  };
+
+  struct histogram_t {
+    std::array<std::uint64_t, BUCKETS.size() + 1> buckets;
+    std::chrono::nanoseconds sum;
+  };
+
+  struct snapshot_t {
+    std::array<std::uint64_t, MAX_COUNTERS> counters;
+    std::array<std::int64_t, MAX_GAUGES> gauges;
+    std::array<histogram_t, MAX_HISTOGRAMS> histograms;
+  };
+
+  explicit session_t(std::uint32_t id) : id { id } {}
+
+  void add(counter_e counter, std::uint64_t n = 1) {
+    _shard().counters[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void set(gauge_e gauge, std::int64_t value) {
+    _gauges[gauge].store(value, std::memory_order_relaxed);
+  }
+
+  void observe(histogram_e histogram, std::chrono::nanoseconds duration);
+
+  snapshot_t snapshot() const;
+
+  const std::uint32_t id;
+
+private:
+  struct histogram_raw_t {
+    std::array<std::atomic<std::uint64_t>, BUCKETS.size() + 1> buckets;
+    std::atomic<std::int64_t> sum;
+  };
+
+  // Each shard gets its own cache lines
+  struct alignas(64) shard_t {
+    std::array<std::atomic<std::uint64_t>, MAX_COUNTERS> counters;
+    std::array<histogram_raw_t, MAX_HISTOGRAMS> histograms;
+  };
+
+  shard_t &_shard();
+
+  std::array<shard_t, SHARDS> _shards {};
+  std::array<std::atomic<std::int64_t>, MAX_GAUGES> _gauges {};
+};
+
+/**
+ * Register the counters of a new session, they are exported for as long as the session holds on to them
+ */
+std::shared_ptr<session_t> alloc();
+
+/**
+ * Render the counters of every live session in the Prometheus text format
+ */
+std::string scrape();
+} // namespace stats
+
+#endif
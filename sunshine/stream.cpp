@@ -4,6 +4,10 @@
 
 #include "process.h"
 
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
 #include <future>
 #include <queue>
 
@@ -17,11 +21,14 @@ extern "C" {
 }
 
 #include "config.h"
+#include "fec.h"
 #include "input.h"
 #include "main.h"
 #include "network.h"
+#include "stats.h"
 #include "stream.h"
 #include "sync.h"
+#include "trace.h"
 #include "thread_safe.h"
 #include "utility.h"
 
@@ -30,6 +37,7 @@ extern "C" {
 #define IDX_START_B 1
 #define IDX_INVALIDATE_REF_FRAMES 2
 #define IDX_LOSS_STATS 3
+#define IDX_FRAME_STATS 4
 #define IDX_INPUT_DATA 5
 #define IDX_RUMBLE_DATA 6
 #define IDX_TERMINATION 7
@@ -40,7 +48,7 @@ static const short packetTypes[] = {
   0x0307, // Start B
   0x0301, // Invalidate reference frames
   0x0201, // Loss Stats
-  0x0204, // Frame Stats (unused)
+  0x0204, // Frame Stats
   0x0206, // Input data
   0x010b, // Rumble data
   0x0100, // Termination
@@ -98,9 +106,149 @@ using video_packet_t     = util::c_ptr<video_packet_raw_t>;
 using audio_packet_t     = util::c_ptr<audio_packet_raw_t>;
 using audio_fec_packet_t = util::c_ptr<audio_fec_packet_raw_t>;
 
-using message_queue_t       = std::shared_ptr<safe::queue_t<std::pair<std::uint16_t, std::string>>>;
+/**
+ * A datagram received on the video or audio port, small enough to be queued without allocating
+ */
+struct message_t {
+  static constexpr std::size_t MAX_SIZE = 256;
+
+  std::uint16_t port;
+  std::uint16_t size;
+  std::array<char, MAX_SIZE> data;
+
+  std::string_view view() const {
+    return { data.data(), size };
+  }
+};
+
+using message_queue_t       = std::shared_ptr<safe::queue_t<message_t>>;
 using message_queue_queue_t = std::shared_ptr<safe::queue_t<std::tuple<socket_e, asio::ip::address, message_queue_t>>>;
 
+/**
+ * Memory the shards of a frame are packetized into, reused from frame to frame
+ */
+class shard_arena_t {
+public:
+  // The first shard starts on a cache line, the others are aligned as far as the blocksize allows
+  static constexpr std::size_t ALIGNMENT = 64;
+
+  char *reserve(std::size_t size) {
+    if(size + ALIGNMENT > _buf.size()) {
+      _buf = util::buffer_t<char> { size + ALIGNMENT };
+    }
+
+    auto p = (std::uintptr_t)_buf.begin();
+    return (char *)((p + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+  }
+
+private:
+  util::buffer_t<char> _buf;
+};
+
+/**
+ * Token bucket spreading the packets of a frame over part of the frame interval
+ */
+struct pacer_t {
+  // Bytes per second the negotiated bitrate amounts to
+  double bitrate_rate;
+
+  // Bytes per second and bucket size in bytes for the current frame
+  double rate;
+  double capacity;
+
+  double tokens;
+  std::chrono::steady_clock::time_point last;
+
+  // Hand the schedule to the kernel instead of sleeping
+  bool txtime;
+
+  void refill(std::chrono::steady_clock::time_point now) {
+    auto elapsed = std::chrono::duration<double> { std::max(now - last, std::chrono::steady_clock::duration::zero()) };
+
+    tokens = std::min(capacity, tokens + rate * elapsed.count());
+    last   = std::max(last, now);
+  }
+};
+
+/**
+ * Moves the FEC percentage of a session with the frame loss its client reports:
+ * up quickly when frames are lost, down slowly while the link stays clean
+ */
+struct fec_controller_t {
+  // How much the percentage is raised for every report of lost frames
+  static constexpr int STEP_UP = 5;
+
+  // How long the link has to stay clean before the percentage is lowered by one
+  static constexpr auto STEP_DOWN_INTERVAL = 1s;
+
+  bool adaptive;
+  int min;
+  int max;
+
+  // Read by the thread sending the video of the session
+  std::atomic<int> percentage;
+
+  // Smoothed ratio of frames lost
+  double loss;
+  std::chrono::milliseconds clean_time;
+
+  void init() {
+    adaptive   = config::stream.adaptive_fec;
+    min        = config::stream.min_fec_percentage;
+    max        = config::stream.max_fec_percentage;
+    loss       = 0.0;
+    clean_time = 0ms;
+
+    percentage = adaptive ? std::clamp(config::stream.fec_percentage, min, max) : config::stream.fec_percentage;
+  }
+
+  void on_loss_stats(int lost_frames, std::chrono::milliseconds interval, int framerate) {
+    if(!adaptive) {
+      return;
+    }
+
+    auto frames = std::max(1.0, interval.count() * framerate / 1000.0);
+    loss        = 0.75 * loss + 0.25 * std::min(1.0, lost_frames / frames);
+
+    if(lost_frames > 0) {
+      // The parity of these frames wasn't enough, scale the step with how much was lost
+      raise(STEP_UP + (int)std::ceil(loss * 100));
+      return;
+    }
+
+    clean_time += interval;
+    if(clean_time >= STEP_DOWN_INTERVAL) {
+      clean_time = 0ms;
+
+      set(percentage.load(std::memory_order_relaxed) - 1);
+    }
+  }
+
+  // A frame couldn't be recovered at all
+  void on_frame_loss() {
+    if(!adaptive) {
+      return;
+    }
+
+    raise(STEP_UP);
+  }
+
+  void raise(int step) {
+    clean_time = 0ms;
+
+    set(percentage.load(std::memory_order_relaxed) + step);
+  }
+
+  void set(int new_percentage) {
+    new_percentage = std::clamp(new_percentage, min, max);
+
+    auto old_percentage = percentage.exchange(new_percentage, std::memory_order_relaxed);
+    if(old_percentage != new_percentage) {
+      BOOST_LOG(debug) << "FEC percentage "sv << old_percentage << "% -> "sv << new_percentage << "%, smoothed frame loss ["sv << loss * 100 << "%]"sv;
+    }
+  }
+};
+
 static inline void while_starting_do_nothing(std::atomic<session::state_e> &state) {
   while(state.load(std::memory_order_acquire) == session::state_e::STARTING) {
     std::this_thread::sleep_for(1ms);
@@ -111,14 +259,32 @@ class control_server_t {
 public:
   int bind(std::uint16_t port) {
     _host = net::host_create(_addr, config::stream.channels, port);
+    if(!_host) {
+      return -1;
+    }
 
-    return !(bool)_host;
+    _poll        = platf::event_poll(_host->socket);
+    _poll_failed = false;
+
+    return 0;
   }
 
   void emplace_addr_to_session(const std::string &addr, session_t &session) {
-    auto lg = _map_addr_session.lock();
+    {
+      auto lg = _map_addr_session.lock();
 
-    _map_addr_session->emplace(addr, std::make_pair(0u, &session));
+      _map_addr_session->emplace(addr, std::make_pair(0u, &session));
+    }
+
+    // The session has a ping deadline to wait for
+    wake();
+  }
+
+  // Let iterate return early, to look at the sessions and the shutdown event
+  void wake() {
+    if(_poll) {
+      _poll->wake();
+    }
   }
 
   // Get session associated with address.
@@ -131,7 +297,11 @@ public:
   //   session refers to broadcast_ctx_t
   //   broadcast_ctx_t refers to control_server_t
   // Therefore, iterate is implemented further down the source file
-  void iterate(std::chrono::milliseconds timeout);
+  /**
+   * Handle the events on the control stream
+   * @param deadline Return once it passes, even without events
+   */
+  void iterate(std::optional<std::chrono::steady_clock::time_point> deadline);
 
   void map(uint16_t type, std::function<void(session_t *, const std::string_view &)> cb) {
     _map_type_cb.emplace(type, std::move(cb));
@@ -156,14 +326,93 @@ public:
 
   ENetAddress _addr;
   net::host_t _host;
+
+  // nullptr if the platform can't wait on the socket and wake() at once
+  // Other threads call wake() at any time, so it's kept until the server is destroyed.
+  std::unique_ptr<platf::event_poll_t> _poll;
+
+  // Only touched by the control thread, once set iterate no longer waits on _poll
+  bool _poll_failed;
+
+private:
+  void _handle(ENetEvent &event);
+
+  /**
+   * ENet only retransmits, pings and times out peers while it's serviced
+   * @return When it has to be serviced next, std::nullopt without peers
+   */
+  std::optional<std::chrono::steady_clock::time_point> _next_service();
+};
+
+template<class T>
+struct worker_t {
+  std::shared_ptr<safe::queue_t<T>> packets;
+  std::thread thread;
+
+  // The number of sessions sending through this worker
+  int sessions;
+};
+
+using audio_worker_t = worker_t<audio::packet_t>;
+
+struct video_worker_ctx_t;
+
+struct video_worker_t {
+  std::shared_ptr<video_worker_ctx_t> ctx;
+  std::thread thread;
+
+  // The number of sessions sending through this worker
+  int sessions;
+};
+
+template<class T, class F>
+std::vector<worker_t<T>> start_workers(int nr_workers, F &&f) {
+  std::vector<worker_t<T>> workers(nr_workers);
+  for(auto &worker : workers) {
+    worker.packets  = std::make_shared<safe::queue_t<T>>(32);
+    worker.sessions = 0;
+    worker.thread   = std::thread { f, worker.packets };
+  }
+
+  return workers;
+}
+
+/**
+ * Bind a session to the worker with the fewest sessions
+ * @return The index of the worker
+ */
+template<class W>
+int assign_worker(std::vector<W> &workers) {
+  auto worker = std::min_element(std::begin(workers), std::end(workers), [](auto &l, auto &r) {
+    return l.sessions < r.sessions;
+  });
+
+  ++worker->sessions;
+  return worker - std::begin(workers);
+}
+
+/**
+ * The packetization and FEC state of the audio stream of a session
+ */
+struct audio_sender_t {
+  static constexpr auto MAX_BLOCK_SIZE = 2048;
+
+  audio_sender_t();
+
+  util::buffer_t<char> shards;
+  util::buffer_t<uint8_t *> shards_p;
+
+  audio_packet_t audio_packet;
+  audio_fec_packet_t audio_fec_packet;
+
+  // The parity packets of a block are sent together
+  util::buffer_t<char> audio_fec_packets;
 };
 
 struct broadcast_ctx_t {
   message_queue_queue_t message_queue_queue;
 
   std::thread recv_thread;
-  std::thread video_thread;
-  std::thread audio_thread;
   std::thread control_thread;
 
   asio::io_service io;
@@ -171,6 +420,17 @@ struct broadcast_ctx_t {
   udp::socket video_sock { io };
   udp::socket audio_sock { io };
   control_server_t control_server;
+
+  // Each session is bound to a single worker of each kind to keep its packets in order
+  std::vector<video_worker_t> video_workers;
+  std::vector<audio_worker_t> audio_workers;
+  std::mutex workers_lock;
+
+  // The audio parity matrix is the same for every session
+  rh_t audio_rs;
+
+  // SO_TXTIME could be enabled on video_sock
+  bool video_txtime;
 };
 
 struct session_t {
@@ -179,6 +439,7 @@ struct session_t {
   safe::mail_t mail;
 
   std::shared_ptr<input::input_t> input;
+  std::shared_ptr<stats::session_t> stats;
 
   std::thread audioThread;
   std::thread videoThread;
@@ -190,21 +451,44 @@ struct session_t {
   struct {
     int lowseq;
     udp::endpoint peer;
+
+    // Index into broadcast_ref->video_workers
+    int worker;
+
+    fec_controller_t fec;
     safe::mail_raw_t::event_t<video::idr_t> idr_events;
+
+    // Frames waiting for the worker, the overflow policy applies to this queue alone
+    video::packet_queue_t packets;
+
+    // Frames dropped because the worker fell behind
+    std::atomic<std::size_t> dropped_frames;
+
+    pacer_t pacer;
+
+    // The shards of the frame being sent, a worker may still be pacing them out
+    shard_arena_t shard_arena;
   } video;
 
   struct {
     std::uint16_t sequenceNumber;
     std::uint32_t timestamp;
     udp::endpoint peer;
+
+    // Index into broadcast_ref->audio_workers
+    int worker;
+
+    std::unique_ptr<audio_sender_t> sender;
   } audio;
 
   struct {
     net::peer_t peer;
   } control;
 
-  crypto::aes_t gcm_key;
+  // Only the control thread decrypts
+  crypto::gcm_t gcm;
   crypto::aes_t iv;
+  std::vector<std::uint8_t> plaintext;
 
   safe::mail_raw_t::event_t<bool> shutdown_event;
   safe::signal_t controlEnd;
@@ -212,6 +496,20 @@ struct session_t {
   std::atomic<session::state_e> state;
 };
 
+/**
+ * Called by the encoder of a session for every frame its queue had no room for
+ */
+void on_video_drop(session_t &session, video::packet_t &packet) {
+  ++session.video.dropped_frames;
+  session.stats->add(stats::VIDEO_DROPS);
+  BOOST_LOG(debug) << "Video worker fell behind, dropped frame "sv << packet->pts;
+
+  if(config::stream.video_queue_overflow == config::stream_t::IDR) {
+    // Frames are dropped oldest first, the last request covers them all
+    session.video.idr_events->raise(std::make_pair(packet->pts, packet->pts + 1));
+  }
+}
+
 int start_broadcast(broadcast_ctx_t &ctx);
 void end_broadcast(broadcast_ctx_t &ctx);
 
@@ -248,175 +546,287 @@ session_t *control_server_t::get_session(const net::peer_t peer) {
   return nullptr;
 }
 
-void control_server_t::iterate(std::chrono::milliseconds timeout) {
+void control_server_t::iterate(std::optional<std::chrono::steady_clock::time_point> deadline) {
   ENetEvent event;
-  auto res = enet_host_service(_host.get(), &event, timeout.count());
 
-  if(res > 0) {
-    auto session = get_session(event.peer);
-    if(!session) {
-      BOOST_LOG(warning) << "Rejected connection from ["sv << platf::from_sockaddr((sockaddr *)&event.peer->address.address) << "]: it's not properly set up"sv;
-      enet_peer_disconnect_now(event.peer, 0);
+  if(!_poll || _poll_failed) {
+    // Wake up periodically to look at the sessions
+    std::chrono::milliseconds timeout = 500ms;
+    if(deadline) {
+      timeout = std::clamp(std::chrono::ceil<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now()), 0ms, timeout);
+    }
 
-      return;
+    if(enet_host_service(_host.get(), &event, timeout.count()) > 0) {
+      _handle(event);
     }
 
-    session->pingTimeout = std::chrono::steady_clock::now() + config::stream.ping_timeout;
+    return;
+  }
 
-    switch(event.type) {
-    case ENET_EVENT_TYPE_RECEIVE: {
-      net::packet_t packet { event.packet };
+  auto service = _next_service();
+  if(service && (!deadline || *service < *deadline)) {
+    deadline = service;
+  }
 
-      auto type = (std::uint16_t *)packet->data;
-      std::string_view payload { (char *)packet->data + sizeof(*type), packet->dataLength - sizeof(*type) };
+  if(_poll->wait(deadline)) {
+    BOOST_LOG(error) << "Couldn't wait for control stream events: "sv << strerror(errno);
 
-      auto cb = _map_type_cb.find(*type);
-      if(cb == std::end(_map_type_cb)) {
-        BOOST_LOG(warning)
-          << "type [Unknown] { "sv << util::hex(*type).to_string_view() << " }"sv << std::endl
-          << "---data---"sv << std::endl
-          << util::hex_vec(payload) << std::endl
-          << "---end data---"sv;
-      }
+    // Don't spin on the error
+    _poll_failed = true;
+    return;
+  }
 
-      else {
-        cb->second(session, payload);
-      }
-    } break;
-    case ENET_EVENT_TYPE_CONNECT:
-      BOOST_LOG(info) << "CLIENT CONNECTED"sv;
-      break;
-    case ENET_EVENT_TYPE_DISCONNECT:
-      BOOST_LOG(info) << "CLIENT DISCONNECTED"sv;
-      // No more clients to send video data to ^_^
-      if(session->state == session::state_e::RUNNING) {
-        session::stop(*session);
-      }
-      break;
-    case ENET_EVENT_TYPE_NONE:
-      break;
-    }
+  // Dispatch everything that arrived, this also sends ENet's acknowledgements
+  while(enet_host_service(_host.get(), &event, 0) > 0) {
+    _handle(event);
   }
 }
 
-namespace fec {
-using rs_t = util::safe_ptr<reed_solomon, reed_solomon_release>;
+std::optional<std::chrono::steady_clock::time_point> control_server_t::_next_service() {
+  auto now = enet_time_get();
 
-struct fec_t {
-  size_t data_shards;
-  size_t nr_shards;
-  size_t percentage;
+  std::optional<enet_uint32> timeout;
+  std::for_each(_host->peers, _host->peers + _host->peerCount, [&](ENetPeer &peer) {
+    if(peer.state == ENET_PEER_STATE_DISCONNECTED) {
+      return;
+    }
 
-  size_t blocksize;
-  util::buffer_t<char> shards;
+    // Reliable commands waiting for an acknowledgement are retransmitted, otherwise the peer is pinged
+    auto due = enet_list_empty(&peer.sentReliableCommands) ?
+                 peer.lastReceiveTime + peer.pingInterval :
+                 peer.nextTimeout;
 
-  char *data(size_t el) {
-    return &shards[el * blocksize];
-  }
+    auto remaining = ENET_TIME_LESS(due, now) ? 0 : ENET_TIME_DIFFERENCE(due, now);
+    timeout        = timeout ? std::min(*timeout, remaining) : remaining;
+  });
 
-  std::string_view operator[](size_t el) const {
-    return { &shards[el * blocksize], blocksize };
+  if(!timeout) {
+    return std::nullopt;
   }
 
-  size_t size() const {
-    return nr_shards;
+  // ENet's clock counts milliseconds, waiting at least one keeps a timer it doesn't act on from spinning
+  return std::chrono::steady_clock::now() + std::chrono::milliseconds { std::max<enet_uint32>(*timeout, 1) };
+}
+
+void control_server_t::_handle(ENetEvent &event) {
+  auto session = get_session(event.peer);
+  if(!session) {
+    BOOST_LOG(warning) << "Rejected connection from ["sv << platf::from_sockaddr((sockaddr *)&event.peer->address.address) << "]: it's not properly set up"sv;
+    enet_peer_disconnect_now(event.peer, 0);
+
+    return;
   }
-};
 
-static fec_t encode(const std::string_view &payload, size_t blocksize, size_t fecpercentage, size_t minparityshards) {
-  auto payload_size = payload.size();
+  session->pingTimeout = std::chrono::steady_clock::now() + config::stream.ping_timeout;
 
-  auto pad = payload_size % blocksize != 0;
+  switch(event.type) {
+  case ENET_EVENT_TYPE_RECEIVE: {
+    net::packet_t packet { event.packet };
 
-  auto data_shards   = payload_size / blocksize + (pad ? 1 : 0);
-  auto parity_shards = (data_shards * fecpercentage + 99) / 100;
+    auto type = (std::uint16_t *)packet->data;
+    std::string_view payload { (char *)packet->data + sizeof(*type), packet->dataLength - sizeof(*type) };
 
-  // increase the FEC percentage for this frame if the parity shard minimum is not met
-  if(parity_shards < minparityshards) {
-    parity_shards = minparityshards;
-    fecpercentage = (100 * parity_shards) / data_shards;
+    auto cb = _map_type_cb.find(*type);
+    if(cb == std::end(_map_type_cb)) {
+      BOOST_LOG(warning)
+        << "type [Unknown] { "sv << util::hex(*type).to_string_view() << " }"sv << std::endl
+        << "---data---"sv << std::endl
+        << util::hex_vec(payload) << std::endl
+        << "---end data---"sv;
+    }
 
-    BOOST_LOG(verbose) << "Increasing FEC percentage to "sv << fecpercentage << " to meet parity shard minimum"sv << std::endl;
+    else {
+      trace::scope_t span { "control", "receive" };
+      cb->second(session, payload);
+    }
+  } break;
+  case ENET_EVENT_TYPE_CONNECT:
+    BOOST_LOG(info) << "CLIENT CONNECTED"sv;
+    break;
+  case ENET_EVENT_TYPE_DISCONNECT:
+    BOOST_LOG(info) << "CLIENT DISCONNECTED"sv;
+    // No more clients to send video data to ^_^
+    if(session->state == session::state_e::RUNNING) {
+      session::stop(*session);
+    }
+    break;
+  case ENET_EVENT_TYPE_NONE:
+    break;
   }
+}
 
-  auto nr_shards = data_shards + parity_shards;
-  if(nr_shards > DATA_SHARDS_MAX) {
-    BOOST_LOG(warning)
-      << "Number of fragments for reed solomon exceeds DATA_SHARDS_MAX"sv << std::endl
-      << nr_shards << " > "sv << DATA_SHARDS_MAX
-      << ", skipping error correction"sv;
+std::vector<uint8_t> replace(const std::string_view &original, const std::string_view &old, const std::string_view &_new) {
+  std::vector<uint8_t> replaced;
 
-    nr_shards     = data_shards;
-    fecpercentage = 0;
-  }
+  auto begin = std::begin(original);
+  auto next  = std::search(begin, std::end(original), std::begin(old), std::end(old));
+
+  std::copy(begin, next, std::back_inserter(replaced));
+  std::copy(std::begin(_new), std::end(_new), std::back_inserter(replaced));
+  std::copy(next + old.size(), std::end(original), std::back_inserter(replaced));
 
-  util::buffer_t<char> shards { nr_shards * blocksize };
-  util::buffer_t<uint8_t *> shards_p { nr_shards };
+  return replaced;
+}
 
-  // copy payload + padding
-  auto next = std::copy(std::begin(payload), std::end(payload), std::begin(shards));
-  std::fill(next, std::end(shards), 0); // padding with zero
+/**
+ * Send block_count blocks of block_size bytes, stored back to back
+ * @return the number of syscalls it took
+ */
+int send_blocks(udp::socket &sock, const udp::endpoint &peer, const char *data, std::size_t block_size, std::size_t block_count,
+  std::optional<std::chrono::steady_clock::time_point> send_time = std::nullopt) {
+  platf::batched_send_info_t send_info {
+    data,
+    block_size,
+    block_count,
+    (std::uintptr_t)sock.native_handle(),
+    peer.data(),
+    (int)peer.size(),
+    send_time,
+  };
 
-  for(auto x = 0; x < nr_shards; ++x) {
-    shards_p[x] = (uint8_t *)&shards[x * blocksize];
+  auto syscalls = platf::send_batch(send_info);
+  if(syscalls >= 0) {
+    return syscalls;
   }
 
-  if(data_shards + parity_shards <= DATA_SHARDS_MAX) {
-    // packets = parity_shards + data_shards
-    rs_t rs { reed_solomon_new(data_shards, parity_shards) };
-
-    reed_solomon_encode(rs.get(), shards_p.begin(), nr_shards, blocksize);
+  for(auto x = 0; x < block_count; ++x) {
+    sock.send_to(asio::buffer(data + x * block_size, block_size), peer);
   }
 
-  return {
-    data_shards,
-    nr_shards,
-    fecpercentage,
-    blocksize,
-    std::move(shards)
-  };
+  return block_count;
 }
-} // namespace fec
 
-template<class F>
-std::vector<uint8_t> insert(uint64_t insert_size, uint64_t slice_size, const std::string_view &data, F &&f) {
-  auto pad      = data.size() % slice_size != 0;
-  auto elements = data.size() / slice_size + (pad ? 1 : 0);
+struct send_stats_t {
+  int syscalls;
+
+  // The most packets released back to back
+  std::size_t burst;
+};
+
+/**
+ * A frame whose packets the pacer hasn't all released yet
+ */
+struct paced_frame_t {
+  session_t *session;
+  fec::fec_t shards;
 
-  std::vector<uint8_t> result;
-  result.resize(elements * insert_size + data.size());
+  std::int64_t pts;
+  bool key_frame;
 
-  auto next = std::begin(data);
-  for(auto x = 0; x < elements - 1; ++x) {
-    void *p = &result[x * (insert_size + slice_size)];
+  // The shards released so far
+  std::size_t sent;
 
-    f(p, x, elements);
+  // When the frame was handed to the sender, and when its first packet was released
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point send_start;
 
-    std::copy(next, next + slice_size, (char *)p + insert_size);
-    next += slice_size;
+  // When the pacer allows the next packets out
+  std::chrono::steady_clock::time_point next;
+
+  send_stats_t stats;
+};
+
+/**
+ * Size the token bucket of the session for a frame
+ */
+void pace(session_t &session, const fec::fec_t &shards, std::chrono::steady_clock::time_point now) {
+  auto &pacer     = session.video.pacer;
+  auto blocksize  = shards.blocksize;
+  auto window     = std::chrono::duration<double> { 1s } * config::stream.pacing_percentage / 100 / session.config.monitor.framerate;
+  auto frame_size = (double)(shards.size() * blocksize);
+
+  // Frames far above the average size, like IDR frames, must still fit in the window
+  pacer.rate     = std::max(pacer.bitrate_rate, frame_size / window.count());
+  pacer.capacity = std::max((double)blocksize, pacer.rate * std::chrono::duration<double> { 1ms }.count());
+
+  pacer.refill(now);
+}
+
+/**
+ * Release the packets of the frame the pacer allows at now
+ * With SO_TXTIME, the kernel is handed the schedule of every remaining packet at once.
+ * @return true once every packet is out, otherwise frame.next is when to call again
+ */
+bool release(udp::socket &sock, paced_frame_t &frame, std::chrono::steady_clock::time_point now) {
+  auto &session  = *frame.session;
+  auto &shards   = frame.shards;
+  auto &pacer    = session.video.pacer;
+  auto blocksize = shards.blocksize;
+
+  if(!config::stream.pacing_percentage) {
+    frame.stats.syscalls += send_blocks(sock, session.video.peer, shards.data(0), blocksize, shards.size());
+    frame.stats.burst = shards.size();
+    frame.sent        = shards.size();
+
+    return true;
   }
 
-  auto x  = elements - 1;
-  void *p = &result[x * (insert_size + slice_size)];
+  auto t = now;
+  pacer.refill(t);
+
+  while(frame.sent < shards.size()) {
+    auto blocks = std::min(shards.size() - frame.sent, (std::size_t)(pacer.tokens / blocksize));
+    if(!blocks) {
+      t += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double> { (blocksize - pacer.tokens) / pacer.rate });
+      if(!pacer.txtime) {
+        frame.next = t;
 
-  f(p, x, elements);
+        return false;
+      }
 
-  std::copy(next, std::end(data), (char *)p + insert_size);
+      pacer.refill(t);
+      continue;
+    }
+
+    std::optional<std::chrono::steady_clock::time_point> send_time;
+    if(pacer.txtime) {
+      send_time = t;
+    }
 
-  return result;
+    frame.stats.syscalls += send_blocks(sock, session.video.peer, shards.data(frame.sent), blocksize, blocks, send_time);
+    frame.stats.burst = std::max(frame.stats.burst, blocks);
+
+    pacer.tokens -= blocks * blocksize;
+    frame.sent += blocks;
+  }
+
+  frame.next = t;
+
+  return true;
 }
 
-std::vector<uint8_t> replace(const std::string_view &original, const std::string_view &old, const std::string_view &_new) {
-  std::vector<uint8_t> replaced;
+/**
+ * Log and count a frame once its last packet is out
+ */
+void finish(paced_frame_t &frame) {
+  auto session = frame.session;
+  auto &shards = frame.shards;
 
-  auto begin = std::begin(original);
-  auto next  = std::search(begin, std::end(original), std::begin(old), std::end(old));
+  auto send_end  = std::chrono::steady_clock::now();
+  auto send_time = std::chrono::duration_cast<std::chrono::microseconds>(send_end - frame.send_start);
 
-  std::copy(begin, next, std::back_inserter(replaced));
-  std::copy(std::begin(_new), std::end(_new), std::back_inserter(replaced));
-  std::copy(next + old.size(), std::end(original), std::back_inserter(replaced));
+  // With SO_TXTIME, the last packet leaves at its scheduled time rather than now
+  auto pacing_delay = std::chrono::duration_cast<std::chrono::microseconds>(frame.next - frame.send_start);
 
-  return replaced;
+  trace::record("video", "send", frame.send_start, send_end);
+
+  if(frame.key_frame) {
+    BOOST_LOG(verbose) << "Key Frame ["sv << frame.pts << "] :: send ["sv << shards.size() << "] shards at ["sv << shards.percentage << "%], ["sv << frame.stats.syscalls << "] syscalls, took ["sv << send_time.count() << "us]"sv;
+  }
+  else {
+    BOOST_LOG(verbose) << "Frame ["sv << frame.pts << "] :: send ["sv << shards.size() << "] shards at ["sv << shards.percentage << "%], ["sv << frame.stats.syscalls << "] syscalls, took ["sv << send_time.count() << "us]"sv << std::endl;
+  }
+
+  if(config::stream.pacing_percentage) {
+    BOOST_LOG(verbose) << "Frame ["sv << frame.pts << "] :: burst ["sv << frame.stats.burst << "] packets, paced over ["sv << pacing_delay.count() << "us]"sv;
+
+    session->stats->observe(stats::PACING_DELAY, pacing_delay);
+  }
+
+  session->stats->add(stats::VIDEO_PACKETS, shards.size());
+  session->stats->add(stats::VIDEO_BYTES, shards.size() * shards.blocksize);
+  session->stats->add(stats::FEC_SHARDS, shards.size() - shards.data_shards);
+  session->stats->observe(stats::SEND_TIME, send_end - frame.start);
 }
 
 void controlBroadcastThread(control_server_t *server) {
@@ -437,6 +847,11 @@ void controlBroadcastThread(control_server_t *server) {
 
     auto lastGoodFrame = stats[3];
 
+    session->video.fec.on_loss_stats(count, t, session->config.monitor.framerate);
+
+    session->stats->add(stats::LOSS_REPORTS);
+    session->stats->add(stats::FRAMES_LOST, std::max(count, 0));
+
     BOOST_LOG(verbose)
       << "type [IDX_LOSS_STATS]"sv << std::endl
       << "---begin stats---" << std::endl
@@ -446,6 +861,15 @@ void controlBroadcastThread(control_server_t *server) {
       << "---end stats---";
   });
 
+  server->map(packetTypes[IDX_FRAME_STATS], [&](session_t *session, const std::string_view &payload) {
+    // Moonlight doesn't document the layout of these, so they are only logged
+    BOOST_LOG(verbose)
+      << "type [IDX_FRAME_STATS] { "sv << payload.size() << " bytes }"sv << std::endl
+      << "---data---"sv << std::endl
+      << util::hex_vec(payload) << std::endl
+      << "---end data---"sv;
+  });
+
   server->map(packetTypes[IDX_INVALIDATE_REF_FRAMES], [&](session_t *session, const std::string_view &payload) {
     auto frames     = (std::int64_t *)payload.data();
     auto firstFrame = frames[0];
@@ -456,6 +880,8 @@ void controlBroadcastThread(control_server_t *server) {
       << "firstFrame [" << firstFrame << ']' << std::endl
       << "lastFrame [" << lastFrame << ']';
 
+    session->video.fec.on_frame_loss();
+    session->stats->add(stats::IDR_REQUESTS);
     session->video.idr_events->raise(std::make_pair(firstFrame, lastFrame));
   });
 
@@ -465,16 +891,14 @@ void controlBroadcastThread(control_server_t *server) {
     int32_t tagged_cipher_length = util::endian::big(*(int32_t *)payload.data());
     std::string_view tagged_cipher { payload.data() + sizeof(tagged_cipher_length), (size_t)tagged_cipher_length };
 
-    crypto::cipher_t cipher { session->gcm_key };
-    cipher.padding = false;
-
-    std::vector<uint8_t> plaintext;
-    if(cipher.decrypt_gcm(session->iv, tagged_cipher, plaintext)) {
+    auto &plaintext = session->plaintext;
+    if(session->gcm.decrypt(session->iv, tagged_cipher, plaintext)) {
       // something went wrong :(
 
       BOOST_LOG(error) << "Failed to verify tag"sv;
 
       session::stop(*session);
+      return;
     }
 
     if(tagged_cipher_length >= 16 + session->iv.size()) {
@@ -482,16 +906,18 @@ void controlBroadcastThread(control_server_t *server) {
     }
 
     input::print(plaintext.data());
-    input::passthrough(session->input, std::move(plaintext));
+    input::passthrough(session->input, plaintext);
   });
 
   auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
   while(!shutdown_event->peek()) {
+    auto now = std::chrono::steady_clock::now();
+
+    // The earliest ping deadline of the sessions left
+    std::optional<std::chrono::steady_clock::time_point> deadline;
     {
       auto lg = server->_map_addr_session.lock();
 
-      auto now = std::chrono::steady_clock::now();
-
       KITTY_WHILE_LOOP(auto pos = std::begin(*server->_map_addr_session), pos != std::end(*server->_map_addr_session), {
         TUPLE_2D_REF(addr, port_session, *pos);
         auto session = port_session.second;
@@ -509,6 +935,10 @@ void controlBroadcastThread(control_server_t *server) {
           continue;
         }
 
+        if(!deadline || session->pingTimeout < *deadline) {
+          deadline = session->pingTimeout;
+        }
+
         ++pos;
       })
     }
@@ -531,13 +961,35 @@ void controlBroadcastThread(control_server_t *server) {
       }
     }
 
-    server->iterate(500ms);
+    // Without a watch on the process, look at it as often as before while there are sessions
+    if(deadline && !proc::proc.watched()) {
+      deadline = std::min(*deadline, now + 500ms);
+    }
+
+    server->iterate(deadline);
   }
 }
 
+struct addr_hash_t {
+  std::size_t operator()(const asio::ip::address &addr) const {
+    if(addr.is_v4()) {
+      return std::hash<std::uint32_t> {}(addr.to_v4().to_uint());
+    }
+
+    auto bytes = addr.to_v6().to_bytes();
+    return std::hash<std::string_view> {}(std::string_view { (char *)bytes.data(), bytes.size() });
+  }
+};
+
+using peer_to_session_t = std::unordered_map<asio::ip::address, message_queue_t, addr_hash_t>;
+
 void recvThread(broadcast_ctx_t &ctx) {
-  std::map<asio::ip::address, message_queue_t> peer_to_video_session;
-  std::map<asio::ip::address, message_queue_t> peer_to_audio_session;
+  // The most datagrams received with a single syscall
+  constexpr std::size_t MAX_RECV_MESSAGES = 16;
+  constexpr std::size_t RECV_BUFFER_SIZE  = 2048;
+
+  peer_to_session_t peer_to_video_session;
+  peer_to_session_t peer_to_audio_session;
 
   auto &video_sock = ctx.video_sock;
   auto &audio_sock = ctx.audio_sock;
@@ -547,10 +999,14 @@ void recvThread(broadcast_ctx_t &ctx) {
 
   auto &io = ctx.io;
 
-  udp::endpoint peer;
+  util::buffer_t<char> buf { MAX_RECV_MESSAGES * RECV_BUFFER_SIZE };
+  std::array<std::size_t, MAX_RECV_MESSAGES> sizes;
+  std::array<sockaddr_storage, MAX_RECV_MESSAGES> sources;
+
+  // Errors that don't stop the sockets from receiving, like ICMP port unreachable
+  std::size_t recv_errors = 0;
 
-  std::array<char, 2048> buf[2];
-  std::function<void(const boost::system::error_code, size_t)> recv_func[2];
+  std::function<void(const boost::system::error_code)> recv_func[2];
 
   auto populate_peer_to_session = [&]() {
     while(message_queue_queue->peek()) {
@@ -578,164 +1034,381 @@ void recvThread(broadcast_ctx_t &ctx) {
     }
   };
 
-  auto recv_func_init = [&](udp::socket &sock, int buf_elem, std::map<asio::ip::address, message_queue_t> &peer_to_session) {
-    recv_func[buf_elem] = [&, buf_elem](const boost::system::error_code &ec, size_t bytes) {
-      auto fg = util::fail_guard([&]() {
-        sock.async_receive_from(asio::buffer(buf[buf_elem]), peer, 0, recv_func[buf_elem]);
-      });
+  auto on_recv_error = [&](const std::string_view &type_str, const std::string &message) {
+    ++recv_errors;
 
-      auto type_str = buf_elem ? "AUDIO"sv : "VIDEO"sv;
-      BOOST_LOG(verbose) << "Recv: "sv << peer.address().to_string() << ':' << peer.port() << " :: " << type_str;
+    BOOST_LOG(warning) << "Couldn't receive data from "sv << type_str << " socket: "sv << message << " ["sv << recv_errors << " errors so far]"sv;
+  };
 
+  auto dispatch = [&](peer_to_session_t &peer_to_session, const std::string_view &type_str, const udp::endpoint &peer, const char *data, std::size_t bytes) {
+    BOOST_LOG(verbose) << "Recv: "sv << peer.address().to_string() << ':' << peer.port() << " :: " << type_str;
 
-      populate_peer_to_session();
+    auto it = peer_to_session.find(peer.address());
+    if(it == std::end(peer_to_session)) {
+      return;
+    }
+
+    if(bytes > message_t::MAX_SIZE) {
+      BOOST_LOG(debug) << "Dropping "sv << bytes << " byte message from "sv << peer.address().to_string() << " :: " << type_str;
+      return;
+    }
+
+    message_t message;
+    message.port = peer.port();
+    message.size = bytes;
+    std::copy_n(data, bytes, std::begin(message.data));
+
+    BOOST_LOG(debug) << "RAISE: "sv << peer.address().to_string() << ":"sv << peer.port() << " :: " << type_str;
+    it->second->raise(message);
+  };
+
+  // Receive everything that is pending on the socket
+  auto drain = [&](udp::socket &sock, const std::string_view &type_str, peer_to_session_t &peer_to_session) {
+    udp::endpoint peer;
+
+    while(true) {
+      platf::batched_recv_info_t recv_info {
+        buf.begin(),
+        RECV_BUFFER_SIZE,
+        MAX_RECV_MESSAGES,
+        (std::uintptr_t)sock.native_handle(),
+        sizes.data(),
+        sources.data(),
+      };
+
+      auto received = platf::recv_batch(recv_info);
+      if(received < 0 && errno == ENOSYS) {
+        if(!sock.available()) {
+          return;
+        }
+
+        boost::system::error_code ec;
+        auto bytes = sock.receive_from(asio::buffer(buf.begin(), RECV_BUFFER_SIZE), peer, 0, ec);
+        if(ec) {
+          on_recv_error(type_str, ec.message());
+          return;
+        }
+
+        dispatch(peer_to_session, type_str, peer, buf.begin(), bytes);
+        continue;
+      }
+
+      if(received < 0) {
+        on_recv_error(type_str, std::strerror(errno));
+
+        // The error was consumed, there may be more datagrams behind it
+        if(errno == ECONNREFUSED || errno == ECONNRESET) {
+          continue;
+        }
 
-      // No data, yet no error
-      if(ec == boost::system::errc::connection_refused || ec == boost::system::errc::connection_reset) {
         return;
       }
 
-      if(ec || !bytes) {
-        BOOST_LOG(fatal) << "Couldn't receive data from udp socket: "sv << ec.message();
+      for(int x = 0; x < received; ++x) {
+        std::memcpy(peer.data(), &sources[x], std::min(peer.capacity(), sizeof(sockaddr_storage)));
+
+        dispatch(peer_to_session, type_str, peer, &buf[x * RECV_BUFFER_SIZE], sizes[x]);
+      }
 
-        log_flush();
-        std::abort();
+      if(received < MAX_RECV_MESSAGES) {
+        return;
       }
+    }
+  };
 
-      auto it = peer_to_session.find(peer.address());
-      if(it != std::end(peer_to_session)) {
-        BOOST_LOG(debug) << "RAISE: "sv << peer.address().to_string() << ":"sv << peer.port() << " :: " << type_str;
-        it->second->raise(peer.port(), std::string { buf[buf_elem].data(), bytes });
+  auto recv_func_init = [&](udp::socket &sock, int buf_elem, peer_to_session_t &peer_to_session) {
+    recv_func[buf_elem] = [&, buf_elem](const boost::system::error_code &ec) {
+      auto fg = util::fail_guard([&]() {
+        sock.async_wait(udp::socket::wait_read, recv_func[buf_elem]);
+      });
+
+      auto type_str = buf_elem ? "AUDIO"sv : "VIDEO"sv;
+
+      populate_peer_to_session();
+
+      if(ec) {
+        on_recv_error(type_str, ec.message());
+        return;
       }
+
+      drain(sock, type_str, peer_to_session);
     };
   };
 
   recv_func_init(video_sock, 0, peer_to_video_session);
   recv_func_init(audio_sock, 1, peer_to_audio_session);
 
-  video_sock.async_receive_from(asio::buffer(buf[0]), peer, 0, recv_func[0]);
-  audio_sock.async_receive_from(asio::buffer(buf[1]), peer, 0, recv_func[1]);
+  video_sock.async_wait(udp::socket::wait_read, recv_func[0]);
+  audio_sock.async_wait(udp::socket::wait_read, recv_func[1]);
 
   while(!broadcast_shutdown_event->peek()) {
     io.run();
   }
 }
 
-void videoBroadcastThread(udp::socket &sock) {
-  auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
-  auto packets        = mail::man->queue<video::packet_t>(mail::video_packets);
+struct video_sender_t {
+  // Frames the pacer is still releasing, at most one per session
+  std::vector<paced_frame_t> paced;
+};
 
-  while(auto packet = packets->pop()) {
-    if(shutdown_event->peek()) {
-      break;
+/**
+ * What a video worker shares with the sessions bound to it
+ *
+ * Each session raises into a queue of its own, so an encoder that gets ahead of the worker
+ * only ever overflows its own queue and drops its own frames.
+ */
+struct video_worker_ctx_t {
+  // Held by the worker while it sends, sessions take it to bind and unbind their queue
+  // Once a session has unbound itself, the worker no longer touches it.
+  std::mutex lock;
+  std::vector<video::packet_queue_t> queues;
+  video_sender_t sender;
+
+  // Set by the sessions after raising a packet, the worker clears it before looking at the queues
+  std::atomic_bool pushed { false };
+  safe::futex_t wake;
+
+  std::atomic_bool running { true };
+};
+
+/**
+ * Release the packets of every paced frame that are due
+ * @return When the next packets are due, std::nullopt once every frame is out
+ */
+std::optional<std::chrono::steady_clock::time_point> release(udp::socket &sock, video_sender_t &sender) {
+  auto now = std::chrono::steady_clock::now();
+
+  std::optional<std::chrono::steady_clock::time_point> next;
+  for(auto it = std::begin(sender.paced); it != std::end(sender.paced);) {
+    if(it->next <= now && release(sock, *it, now)) {
+      finish(*it);
+
+      it = sender.paced.erase(it);
+      continue;
     }
 
-    auto session = (session_t *)packet->channel_data;
-    auto lowseq  = session->video.lowseq;
+    next = next ? std::min(*next, it->next) : it->next;
+    ++it;
+  }
 
-    std::string_view payload { (char *)packet->data, (size_t)packet->size };
-    std::vector<uint8_t> payload_new;
+  return next;
+}
 
-    auto nv_packet_header = "\0017charss"sv;
-    std::copy(std::begin(nv_packet_header), std::end(nv_packet_header), std::back_inserter(payload_new));
-    std::copy(std::begin(payload), std::end(payload), std::back_inserter(payload_new));
+/**
+ * Packetize, protect and send an encoded frame
+ */
+void send_video_packet(udp::socket &sock, video_sender_t &sender, video::packet_raw_t &packet) {
+  auto start = std::chrono::steady_clock::now();
 
-    payload = { (char *)payload_new.data(), payload_new.size() };
+  auto session = (session_t *)packet.channel_data;
+  auto lowseq  = session->video.lowseq;
 
-    if(packet->flags & AV_PKT_FLAG_KEY) {
-      for(auto &replacement : *packet->replacements) {
-        auto frame_old = replacement.old;
-        auto frame_new = replacement._new;
+  // The previous frame of the session is still being paced, it shares the arena with this one
+  auto previous = std::find_if(std::begin(sender.paced), std::end(sender.paced), [session](auto &frame) {
+    return frame.session == session;
+  });
+  if(previous != std::end(sender.paced)) {
+    auto &shards = previous->shards;
 
-        payload_new = replace(payload, frame_old, frame_new);
-        payload     = { (char *)payload_new.data(), payload_new.size() };
-      }
+    previous->stats.syscalls += send_blocks(sock, session->video.peer, shards.data(previous->sent), shards.blocksize, shards.size() - previous->sent);
+    previous->next = start;
+    finish(*previous);
+
+    sender.paced.erase(previous);
+    session->stats->add(stats::PACING_OVERRUNS);
+  }
+
+  // The encoder output is read in place, unless headers have to be replaced
+  std::string_view payload { (char *)packet.data, (size_t)packet.size };
+  std::vector<uint8_t> payload_new;
+
+  if(packet.flags & AV_PKT_FLAG_KEY) {
+    for(auto &replacement : *packet.replacements) {
+      auto frame_old = replacement.old;
+      auto frame_new = replacement._new;
+
+      payload_new = replace(payload, frame_old, frame_new);
+      payload     = { (char *)payload_new.data(), payload_new.size() };
     }
+  }
 
-    // insert packet headers
-    auto blocksize         = session->config.packetsize + MAX_RTP_HEADER_SIZE;
-    auto payload_blocksize = blocksize - sizeof(video_packet_raw_t);
+  auto nv_packet_header = "\0017charss"sv;
 
-    auto fecPercentage = config::stream.fec_percentage;
+  auto blocksize         = session->config.packetsize + MAX_RTP_HEADER_SIZE;
+  auto payload_blocksize = blocksize - sizeof(video_packet_raw_t);
 
-    payload_new = insert(sizeof(video_packet_raw_t), payload_blocksize,
-      payload, [&](void *p, int fecIndex, int end) {
-        video_packet_raw_t *video_packet = (video_packet_raw_t *)p;
+  auto fecPercentage = session->video.fec.percentage.load(std::memory_order_relaxed);
 
-        video_packet->packet.flags             = FLAG_CONTAINS_PIC_DATA;
-        video_packet->packet.frameIndex        = packet->pts;
-        video_packet->packet.streamPacketIndex = ((uint32_t)lowseq + fecIndex) << 8;
+  auto data_shards = (nv_packet_header.size() + payload.size() + payload_blocksize - 1) / payload_blocksize;
 
-        if(fecIndex == 0) {
-          video_packet->packet.flags |= FLAG_SOF;
-        }
+  // The data shards are followed by room for the parity shards
+  auto nr_shards = data_shards + fec::parity_shards(data_shards, fecPercentage, session->config.minRequiredFecPackets);
 
-        if(fecIndex == end - 1) {
-          video_packet->packet.flags |= FLAG_EOF;
-        }
+  trace::scope_t packetize { "video", "packetize" };
 
-        video_packet->rtp.header         = FLAG_EXTENSION;
-        video_packet->rtp.sequenceNumber = util::endian::big<uint16_t>(lowseq + fecIndex);
-      });
+  auto frame_shards = session->video.shard_arena.reserve(nr_shards * blocksize);
 
-    payload = { (char *)payload_new.data(), payload_new.size() };
+  // Scatter the frame into the data shards
+  std::array<std::string_view, 2> sources { nv_packet_header, payload };
+  auto source = std::begin(sources);
 
-    auto shards = fec::encode(payload, blocksize, fecPercentage, session->config.minRequiredFecPackets);
-    if(shards.data_shards == 0) {
-      BOOST_LOG(info) << "skipping frame..."sv << std::endl;
-      continue;
-    }
+  for(std::size_t fecIndex = 0; fecIndex < data_shards; ++fecIndex) {
+    auto *video_packet = (video_packet_raw_t *)&frame_shards[fecIndex * blocksize];
+
+    std::memset(video_packet, 0, sizeof(video_packet_raw_t));
 
-    for(auto x = shards.data_shards; x < shards.size(); ++x) {
-      auto *inspect = (video_packet_raw_t *)shards.data(x);
+    video_packet->packet.flags             = FLAG_CONTAINS_PIC_DATA;
+    video_packet->packet.frameIndex        = packet.pts;
+    video_packet->packet.streamPacketIndex = ((uint32_t)lowseq + fecIndex) << 8;
 
-      inspect->packet.frameIndex = packet->pts;
+    if(fecIndex == 0) {
+      video_packet->packet.flags |= FLAG_SOF;
+    }
 
-      inspect->rtp.header         = FLAG_EXTENSION;
-      inspect->rtp.sequenceNumber = util::endian::big<uint16_t>(lowseq + x);
+    if(fecIndex == data_shards - 1) {
+      video_packet->packet.flags |= FLAG_EOF;
     }
 
-    // set FEC info now that we know for sure what our percentage will be for this frame
-    for(auto x = 0; x < shards.size(); ++x) {
-      auto *inspect = (video_packet_raw_t *)shards.data(x);
+    video_packet->rtp.header = FLAG_EXTENSION;
+
+    auto dest = (char *)video_packet->payload();
+    auto size = payload_blocksize;
+    while(size && source != std::end(sources)) {
+      auto bytes = std::min(size, source->size());
+
+      dest = std::copy_n(source->data(), bytes, dest);
+      source->remove_prefix(bytes);
+      size -= bytes;
 
-      inspect->packet.fecInfo = (x << 12 |
-                                 shards.data_shards << 22 |
-                                 shards.percentage << 4);
+      if(source->empty()) {
+        ++source;
+      }
     }
 
-    for(auto x = 0; x < shards.size(); ++x) {
-      sock.send_to(asio::buffer(shards[x]), session->video.peer);
+    // padding with zero
+    std::fill_n(dest, size, 0);
+  }
+
+  packetize.end();
+
+  // Compute the parity in place
+  trace::scope_t protect { "video", "fec" };
+  auto shards = fec::encode(frame_shards, data_shards, blocksize, fecPercentage, session->config.minRequiredFecPackets);
+  protect.end();
+
+  for(auto x = shards.data_shards; x < shards.size(); ++x) {
+    auto *inspect = (video_packet_raw_t *)shards.data(x);
+
+    inspect->packet.frameIndex = packet.pts;
+
+    inspect->rtp.header = FLAG_EXTENSION;
+  }
+
+  // set FEC info now that we know for sure what our percentage will be for this frame
+  for(auto x = 0; x < shards.size(); ++x) {
+    auto *inspect = (video_packet_raw_t *)shards.data(x);
+
+    inspect->packet.fecInfo = (x << 12 |
+                               shards.data_shards << 22 |
+                               shards.percentage << 4);
+
+    inspect->rtp.sequenceNumber = util::endian::big<uint16_t>(lowseq + x);
+  }
+
+  session->video.lowseq = lowseq + shards.size();
+
+  paced_frame_t frame { session, shards, packet.pts, (packet.flags & AV_PKT_FLAG_KEY) != 0, 0, start, std::chrono::steady_clock::now() };
+
+  if(config::stream.pacing_percentage) {
+    pace(*session, shards, frame.send_start);
+  }
+
+  if(release(sock, frame, frame.send_start)) {
+    finish(frame);
+    return;
+  }
+
+  sender.paced.emplace_back(std::move(frame));
+}
+
+void videoBroadcastThread(udp::socket &sock, std::shared_ptr<video_worker_ctx_t> ctx) {
+  auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
+
+  auto &sender = ctx->sender;
+
+  auto ready = [&ctx]() {
+    return ctx->pushed.exchange(false) || !ctx->running;
+  };
+
+  // A session still had frames waiting after its last turn
+  bool more = false;
+
+  std::optional<std::chrono::steady_clock::time_point> next;
+  while(true) {
+    // Waiting for the next frame mustn't hold up the paced packets of other sessions
+    if(!more && next) {
+      ctx->wake.wait_for(ready, std::max(*next - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero()));
+    }
+    else if(!more) {
+      ctx->wake.wait(ready);
     }
 
-    if(packet->flags & AV_PKT_FLAG_KEY) {
-      BOOST_LOG(verbose) << "Key Frame ["sv << packet->pts << "] :: send ["sv << shards.size() << "] shards..."sv;
+    if(shutdown_event->peek() || !ctx->running) {
+      break;
     }
-    else {
-      BOOST_LOG(verbose) << "Frame ["sv << packet->pts << "] :: send ["sv << shards.size() << "] shards..."sv << std::endl;
+
+    std::lock_guard lg { ctx->lock };
+
+    // Each session sends a single frame per turn, so a session that got ahead can't starve the others
+    more = false;
+    for(auto &packets : ctx->queues) {
+      if(!packets->peek()) {
+        continue;
+      }
+
+      auto packet = packets->pop();
+      if(!packet) {
+        continue;
+      }
+
+      ((session_t *)packet->channel_data)->stats->set(stats::VIDEO_QUEUE_DEPTH, packets->size());
+
+      send_video_packet(sock, sender, *packet);
+
+      more = more || packets->peek();
     }
 
-    session->video.lowseq += shards.size();
+    next = release(sock, sender);
   }
 
   shutdown_event->raise(true);
 }
 
-void audioBroadcastThread(udp::socket &sock) {
-  auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
-  auto packets        = mail::man->queue<audio::packet_t>(mail::audio_packets);
-
-  auto max_block_size = 2048;
-  util::buffer_t<char> shards { RTPA_TOTAL_SHARDS * 2048 };
-  util::buffer_t<uint8_t *> shards_p { RTPA_TOTAL_SHARDS };
-
+audio_sender_t::audio_sender_t()
+    : shards { RTPA_TOTAL_SHARDS * MAX_BLOCK_SIZE },
+      shards_p { RTPA_TOTAL_SHARDS },
+      audio_packet { (audio_packet_raw_t *)malloc(sizeof(audio_packet_raw_t) + MAX_BLOCK_SIZE) },
+      audio_fec_packet { (audio_fec_packet_raw_t *)malloc(sizeof(audio_fec_packet_raw_t) + MAX_BLOCK_SIZE) },
+      audio_fec_packets { RTPA_FEC_SHARDS * (sizeof(audio_fec_packet_raw_t) + MAX_BLOCK_SIZE) } {
   for(auto x = 0; x < RTPA_TOTAL_SHARDS; ++x) {
-    shards_p[x] = (uint8_t *)&shards[x * max_block_size];
+    shards_p[x] = (uint8_t *)&shards[x * MAX_BLOCK_SIZE];
   }
 
-  audio_packet_t audio_packet { (audio_packet_raw_t *)malloc(sizeof(audio_packet_raw_t) + max_block_size) };
-  audio_fec_packet_t audio_fec_packet { (audio_fec_packet_raw_t *)malloc(sizeof(audio_fec_packet_raw_t) + max_block_size) };
-  fec::rs_t rs { reed_solomon_new(RTPA_DATA_SHARDS, RTPA_FEC_SHARDS) };
+  audio_packet->rtp.header     = 0x80;
+  audio_packet->rtp.packetType = 97;
+  audio_packet->rtp.ssrc       = 0;
+
+  audio_fec_packet->rtp.header     = 0x80;
+  audio_fec_packet->rtp.packetType = 127;
+  audio_fec_packet->rtp.timestamp  = 0;
+  audio_fec_packet->rtp.ssrc       = 0;
+
+  audio_fec_packet->fecHeader.payloadType = audio_packet->rtp.packetType;
+  audio_fec_packet->fecHeader.ssrc        = audio_packet->rtp.ssrc;
+}
+
+rh_t make_audio_rs() {
+  rh_t rs { reed_solomon_new(RTPA_DATA_SHARDS, RTPA_FEC_SHARDS) };
 
   // For unknown reasons, the RS parity matrix computed by our RS implementation
   // doesn't match the one Nvidia uses for audio data. I'm not exactly sure why,
@@ -746,59 +1419,76 @@ void audioBroadcastThread(udp::socket &sock) {
   memcpy(&rs.get()->m[16], parity, sizeof(parity));
   memcpy(rs.get()->parity, parity, sizeof(parity));
 
-  audio_packet->rtp.header     = 0x80;
-  audio_packet->rtp.packetType = 97;
-  audio_packet->rtp.ssrc       = 0;
+  return rs;
+}
 
-  audio_fec_packet->rtp.header     = 0x80;
-  audio_fec_packet->rtp.packetType = 127;
-  audio_fec_packet->rtp.timestamp  = 0;
-  audio_fec_packet->rtp.ssrc       = 0;
+void send_audio_packet(udp::socket &sock, const reed_solomon *rs, session_t &session, const audio::buffer_t &packet_data) {
+  trace::scope_t span { "audio", "send" };
 
-  audio_fec_packet->fecHeader.payloadType = audio_packet->rtp.packetType;
-  audio_fec_packet->fecHeader.ssrc        = audio_packet->rtp.ssrc;
+  auto &sender = *session.audio.sender;
 
-  while(auto packet = packets->pop()) {
-    if(shutdown_event->peek()) {
-      break;
-    }
+  auto &audio_packet     = sender.audio_packet;
+  auto &audio_fec_packet = sender.audio_fec_packet;
+  auto &shards_p         = sender.shards_p;
 
-    TUPLE_2D_REF(channel_data, packet_data, *packet);
-    auto session = (session_t *)channel_data;
+  auto sequenceNumber = session.audio.sequenceNumber;
+  auto timestamp      = session.audio.timestamp;
 
-    auto sequenceNumber = session->audio.sequenceNumber;
-    auto timestamp      = session->audio.timestamp;
+  audio_packet->rtp.sequenceNumber = util::endian::big(sequenceNumber);
+  audio_packet->rtp.timestamp      = util::endian::big(timestamp);
 
-    audio_packet->rtp.sequenceNumber = util::endian::big(sequenceNumber);
-    audio_packet->rtp.timestamp      = util::endian::big(timestamp);
+  session.audio.sequenceNumber++;
+  session.audio.timestamp += session.config.audio.packetDuration;
 
-    session->audio.sequenceNumber++;
-    session->audio.timestamp += session->config.audio.packetDuration;
+  std::copy(std::begin(packet_data), std::end(packet_data), audio_packet->payload());
+  std::copy(std::begin(packet_data), std::end(packet_data), shards_p[sequenceNumber % RTPA_DATA_SHARDS]);
 
-    std::copy(std::begin(packet_data), std::end(packet_data), audio_packet->payload());
-    std::copy(std::begin(packet_data), std::end(packet_data), shards_p[sequenceNumber % RTPA_DATA_SHARDS]);
+  sock.send_to(asio::buffer((char *)audio_packet.get(), sizeof(audio_packet_raw_t) + packet_data.size()), session.audio.peer);
+  session.stats->add(stats::AUDIO_PACKETS);
+  session.stats->add(stats::AUDIO_BYTES, sizeof(audio_packet_raw_t) + packet_data.size());
+  BOOST_LOG(verbose) << "Audio ["sv << sequenceNumber << "] ::  send..."sv;
 
-    sock.send_to(asio::buffer((char *)audio_packet.get(), sizeof(audio_packet_raw_t) + packet_data.size()), session->audio.peer);
-    BOOST_LOG(verbose) << "Audio ["sv << sequenceNumber << "] ::  send..."sv;
+  // initialize the FEC header at the beginning of the FEC block
+  if(sequenceNumber % RTPA_DATA_SHARDS == 0) {
+    audio_fec_packet->fecHeader.baseSequenceNumber = util::endian::big(sequenceNumber);
+    audio_fec_packet->fecHeader.baseTimestamp      = util::endian::big(timestamp);
+  }
+
+  // generate parity shards at the end of the FEC block
+  if((sequenceNumber + 1) % RTPA_DATA_SHARDS == 0) {
+    fec::encode_parity(rs, shards_p.begin(), packet_data.size());
+
+    auto fec_packet_size = sizeof(audio_fec_packet_raw_t) + packet_data.size();
+    for(auto x = 0; x < RTPA_FEC_SHARDS; ++x) {
+      audio_fec_packet->rtp.sequenceNumber      = util::endian::big(sequenceNumber + x + 1);
+      audio_fec_packet->fecHeader.fecShardIndex = x;
 
-    // initialize the FEC header at the beginning of the FEC block
-    if(sequenceNumber % RTPA_DATA_SHARDS == 0) {
-      audio_fec_packet->fecHeader.baseSequenceNumber = util::endian::big(sequenceNumber);
-      audio_fec_packet->fecHeader.baseTimestamp      = util::endian::big(timestamp);
+      auto fec_packet = (audio_fec_packet_raw_t *)&sender.audio_fec_packets[x * fec_packet_size];
+      *fec_packet     = *audio_fec_packet;
+      memcpy(fec_packet->payload(), shards_p[RTPA_DATA_SHARDS + x], packet_data.size());
     }
 
-    // generate parity shards at the end of the FEC block
-    if((sequenceNumber + 1) % RTPA_DATA_SHARDS == 0) {
-      reed_solomon_encode(rs.get(), shards_p.begin(), RTPA_TOTAL_SHARDS, packet_data.size());
+    send_blocks(sock, session.audio.peer, sender.audio_fec_packets.begin(), fec_packet_size, RTPA_FEC_SHARDS);
+    session.stats->add(stats::AUDIO_PACKETS, RTPA_FEC_SHARDS);
+    session.stats->add(stats::AUDIO_BYTES, RTPA_FEC_SHARDS * fec_packet_size);
+    BOOST_LOG(verbose) << "Audio FEC ["sv << (sequenceNumber & ~(RTPA_DATA_SHARDS - 1)) << "] ::  send..."sv;
+  }
+}
 
-      for(auto x = 0; x < RTPA_FEC_SHARDS; ++x) {
-        audio_fec_packet->rtp.sequenceNumber      = util::endian::big(sequenceNumber + x + 1);
-        audio_fec_packet->fecHeader.fecShardIndex = x;
-        memcpy(audio_fec_packet->payload(), shards_p[RTPA_DATA_SHARDS + x], packet_data.size());
-        sock.send_to(asio::buffer((char *)audio_fec_packet.get(), sizeof(audio_fec_packet_raw_t) + packet_data.size()), session->audio.peer);
-        BOOST_LOG(verbose) << "Audio FEC ["sv << (sequenceNumber & ~(RTPA_DATA_SHARDS - 1)) << ' ' << x << "] ::  send..."sv;
-      }
+void audioBroadcastThread(udp::socket &sock, const reed_solomon *rs, audio::packet_queue_t packets) {
+  auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
+
+  while(auto packet = packets->pop()) {
+    if(shutdown_event->peek()) {
+      break;
     }
+
+    TUPLE_2D_REF(channel_data, packet_data, *packet);
+
+    auto &session = *(session_t *)channel_data;
+    session.stats->set(stats::AUDIO_QUEUE_DEPTH, packets->size());
+
+    send_audio_packet(sock, rs, session, packet_data);
   }
 
   shutdown_event->raise(true);
@@ -844,12 +1534,37 @@ int start_broadcast(broadcast_ctx_t &ctx) {
     return -1;
   }
 
+  ctx.video_txtime = false;
+  if(config::stream.pacing_percentage && config::stream.pacing_txtime) {
+    ctx.video_txtime = !platf::enable_txtime((std::uintptr_t)ctx.video_sock.native_handle());
+  }
+
   ctx.message_queue_queue = std::make_shared<message_queue_queue_t::element_type>(30);
 
-  ctx.video_thread   = std::thread { videoBroadcastThread, std::ref(ctx.video_sock) };
-  ctx.audio_thread   = std::thread { audioBroadcastThread, std::ref(ctx.audio_sock) };
+  ctx.audio_rs = make_audio_rs();
+
+  // There is no point in more workers than sessions or cores
+  auto nr_workers = std::max(1, std::min(config::stream.channels, (int)std::thread::hardware_concurrency()));
+
+  ctx.video_workers.resize(nr_workers);
+  for(auto &worker : ctx.video_workers) {
+    worker.ctx      = std::make_shared<video_worker_ctx_t>();
+    worker.sessions = 0;
+    worker.thread   = std::thread { videoBroadcastThread, std::ref(ctx.video_sock), worker.ctx };
+  }
+
+  // Audio is a small fraction of the traffic of video
+  ctx.audio_workers = start_workers<audio::packet_t>((nr_workers + 3) / 4, [&ctx](audio::packet_queue_t packets) {
+    audioBroadcastThread(ctx.audio_sock, ctx.audio_rs.get(), std::move(packets));
+  });
+
   ctx.control_thread = std::thread { controlBroadcastThread, &ctx.control_server };
 
+  // Tell the clients right away when the app exits
+  proc::on_exit([&ctx]() {
+    ctx.control_server.wake();
+  });
+
   ctx.recv_thread = std::thread { recvThread, std::ref(ctx) };
 
   return 0;
@@ -858,14 +1573,19 @@ int start_broadcast(broadcast_ctx_t &ctx) {
 void end_broadcast(broadcast_ctx_t &ctx) {
   auto broadcast_shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
 
-  broadcast_shutdown_event->raise(true);
+  proc::on_exit(nullptr);
 
-  auto video_packets = mail::man->queue<video::packet_t>(mail::video_packets);
-  auto audio_packets = mail::man->queue<audio::packet_t>(mail::audio_packets);
+  broadcast_shutdown_event->raise(true);
+  ctx.control_server.wake();
 
   // Minimize delay stopping video/audio threads
-  video_packets->stop();
-  audio_packets->stop();
+  for(auto &worker : ctx.video_workers) {
+    worker.ctx->running = false;
+    worker.ctx->wake.bump();
+  }
+  for(auto &worker : ctx.audio_workers) {
+    worker.packets->stop();
+  }
 
   ctx.message_queue_queue->stop();
   ctx.io.stop();
@@ -873,15 +1593,18 @@ void end_broadcast(broadcast_ctx_t &ctx) {
   ctx.video_sock.close();
   ctx.audio_sock.close();
 
-  video_packets.reset();
-  audio_packets.reset();
-
   BOOST_LOG(debug) << "Waiting for main listening thread to end..."sv;
   ctx.recv_thread.join();
-  BOOST_LOG(debug) << "Waiting for main video thread to end..."sv;
-  ctx.video_thread.join();
-  BOOST_LOG(debug) << "Waiting for main audio thread to end..."sv;
-  ctx.audio_thread.join();
+  BOOST_LOG(debug) << "Waiting for main video threads to end..."sv;
+  for(auto &worker : ctx.video_workers) {
+    worker.thread.join();
+  }
+  ctx.video_workers.clear();
+  BOOST_LOG(debug) << "Waiting for main audio threads to end..."sv;
+  for(auto &worker : ctx.audio_workers) {
+    worker.thread.join();
+  }
+  ctx.audio_workers.clear();
   BOOST_LOG(debug) << "Waiting for main control thread to end..."sv;
   ctx.control_thread.join();
   BOOST_LOG(debug) << "All broadcasting threads ended"sv;
@@ -909,15 +1632,15 @@ int recv_ping(decltype(broadcast)::ptr_t ref, socket_e type, asio::ip::address &
     return -1;
   }
 
-  TUPLE_2D_REF(port, msg, *msg_opt);
+  auto msg = msg_opt->view();
   if(msg != ping) {
     BOOST_LOG(error) << "First message is not a PING";
-    BOOST_LOG(debug) << "Received from "sv << addr << ':' << port << " ["sv << util::hex_vec(msg) << ']';
+    BOOST_LOG(debug) << "Received from "sv << addr << ':' << msg_opt->port << " ["sv << util::hex_vec(msg) << ']';
 
     return -1;
   }
 
-  return port;
+  return msg_opt->port;
 }
 
 void videoThread(session_t *session, std::string addr_str) {
@@ -937,8 +1660,39 @@ void videoThread(session_t *session, std::string addr_str) {
   session->video.peer.address(addr);
   session->video.peer.port(port);
 
+  video::packet_sink_t send;
+  if(config::stream.inline_send) {
+    auto sender = std::make_shared<video_sender_t>();
+
+    send = [&sock = ref->video_sock, sender](video::packet_t &&packet) {
+      send_video_packet(sock, *sender, *packet);
+
+      // Only this session sends from here, so it can sleep until the pacer releases the rest
+      while(auto next = release(sock, *sender)) {
+        std::this_thread::sleep_until(*next);
+      }
+    };
+  }
+  else {
+    send = [packets = session->video.packets, ctx = ref->video_workers[session->video.worker].ctx](video::packet_t &&packet) {
+      packets->raise(std::move(packet));
+
+      ctx->pushed = true;
+      ctx->wake.bump();
+    };
+  }
+
+  auto sink = [session, send = std::move(send)](video::packet_t &&packet) {
+    session->stats->add(stats::FRAMES_ENCODED);
+    if(packet->flags & AV_PKT_FLAG_KEY) {
+      session->stats->add(stats::IDR_FRAMES);
+    }
+
+    send(std::move(packet));
+  };
+
   BOOST_LOG(debug) << "Start capturing Video"sv;
-  video::capture(session->mail, session->config.monitor, session);
+  video::capture(session->mail, session->config.monitor, std::move(sink), *session->stats, session);
 }
 
 void audioThread(session_t *session, std::string addr_str) {
@@ -960,7 +1714,7 @@ void audioThread(session_t *session, std::string addr_str) {
   session->audio.peer.port(port);
 
   BOOST_LOG(debug) << "Start capturing Audio"sv;
-  audio::capture(session->mail, session->config.audio, session);
+  audio::capture(session->mail, session->config.audio, ref->audio_workers[session->audio.worker].packets, *session->stats, session);
 }
 
 namespace session {
@@ -977,6 +1731,11 @@ void stop(session_t &session) {
   }
 
   session.shutdown_event->raise(true);
+
+  // Let the control thread disconnect the session right away
+  if(session.broadcast_ref) {
+    session.broadcast_ref->control_server.wake();
+  }
 }
 
 void join(session_t &session) {
@@ -986,6 +1745,36 @@ void join(session_t &session) {
   session.audioThread.join();
   BOOST_LOG(debug) << "Waiting for control to end..."sv;
   session.controlEnd.view();
+
+  auto dropped = session.video.dropped_frames.load();
+  if(dropped) {
+    BOOST_LOG(info) << "Dropped "sv << dropped << " video frames, the video worker couldn't keep up"sv;
+  }
+
+  {
+    auto &ctx = *session.broadcast_ref.get();
+
+    std::lock_guard lg { ctx.workers_lock };
+
+    auto &worker = ctx.video_workers[session.video.worker];
+    {
+      std::lock_guard worker_lg { worker.ctx->lock };
+
+      // The frames still queued are dropped with the session
+      auto &queues = worker.ctx->queues;
+      queues.erase(std::remove(std::begin(queues), std::end(queues), session.video.packets), std::end(queues));
+
+      // The frame still being paced out points into the session and its shard arena
+      auto &paced = worker.ctx->sender.paced;
+      paced.erase(std::remove_if(std::begin(paced), std::end(paced), [&session](auto &frame) {
+        return frame.session == &session;
+      }),
+        std::end(paced));
+    }
+
+    --worker.sessions;
+    --ctx.audio_workers[session.audio.worker].sessions;
+  }
   //Reset input on session stop to avoid stuck repeated keys
   BOOST_LOG(debug) << "Resetting Input..."sv;
   input::reset(session.input);
@@ -993,7 +1782,7 @@ void join(session_t &session) {
 }
 
 int start(session_t &session, const std::string &addr_string) {
-  session.input = input::alloc(session.mail);
+  session.input = input::alloc(session.mail, session.stats);
 
   session.broadcast_ref = broadcast.ref();
   if(!session.broadcast_ref) {
@@ -1004,6 +1793,35 @@ int start(session_t &session, const std::string &addr_string) {
 
   session.pingTimeout = std::chrono::steady_clock::now() + config::stream.ping_timeout;
 
+  session.video.pacer.txtime = session.broadcast_ref->video_txtime;
+
+  auto overflow = safe::overflow_e::flush;
+  switch(config::stream.video_queue_overflow) {
+  case config::stream_t::BLOCK:
+    overflow = safe::overflow_e::block;
+    break;
+  case config::stream_t::DROP:
+    overflow = safe::overflow_e::drop_newest;
+    break;
+  }
+
+  session.video.packets = std::make_shared<video::packet_queue_t::element_type>(32, overflow, [&session](video::packet_t &packet) {
+    on_video_drop(session, packet);
+  });
+
+  {
+    auto &ctx = *session.broadcast_ref.get();
+
+    std::lock_guard lg { ctx.workers_lock };
+    session.video.worker = assign_worker(ctx.video_workers);
+    session.audio.worker = assign_worker(ctx.audio_workers);
+
+    auto &worker = *ctx.video_workers[session.video.worker].ctx;
+
+    std::lock_guard worker_lg { worker.lock };
+    worker.queues.emplace_back(session.video.packets);
+  }
+
   session.audioThread = std::thread { audioThread, &session, addr_string };
   session.videoThread = std::thread { videoThread, &session, addr_string };
 
@@ -1019,15 +1837,24 @@ std::shared_ptr<session_t> alloc(config_t &config, crypto::aes_t &gcm_key, crypt
 
   session->shutdown_event = mail->event<bool>(mail::shutdown);
 
-  session->config  = config;
-  session->gcm_key = gcm_key;
-  session->iv      = iv;
+  session->config = config;
+  session->gcm    = crypto::gcm_t { gcm_key };
+  session->iv     = iv;
+  session->stats  = stats::alloc();
 
   session->video.idr_events = mail->event<video::idr_t>(mail::idr);
   session->video.lowseq     = 0;
 
+  // bitrate is in kilobits per second
+  session->video.pacer              = pacer_t {};
+  session->video.pacer.bitrate_rate = config.monitor.bitrate * 1000.0 / 8;
+
+  session->video.fec.init();
+  session->video.dropped_frames = 0;
+
   session->audio.sequenceNumber = 0;
   session->audio.timestamp      = 0;
+  session->audio.sender         = std::make_unique<audio_sender_t>();
 
   session->control.peer = nullptr;
   session->state.store(state_e::STOPPED, std::memory_order_relaxed);
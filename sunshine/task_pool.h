@@ -8,6 +8,7 @@
 #include <mutex>
 #include <optional>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -55,16 +56,23 @@ public:
 
 protected:
   std::deque<__task> _tasks;
+
+  // A binary min-heap ordered on the time point
   std::vector<std::pair<__time_point, __task>> _timer_tasks;
+
+  // The position of each timer task in _timer_tasks
+  std::unordered_map<task_id_t, std::size_t> _timer_index;
   std::mutex _task_mutex;
 
 public:
   TaskPool() = default;
-  TaskPool(TaskPool &&other) noexcept : _tasks { std::move(other._tasks) }, _timer_tasks { std::move(other._timer_tasks) } {}
+  TaskPool(TaskPool &&other) noexcept
+      : _tasks { std::move(other._tasks) }, _timer_tasks { std::move(other._timer_tasks) }, _timer_index { std::move(other._timer_index) } {}
 
   TaskPool &operator=(TaskPool &&other) noexcept {
     std::swap(_tasks, other._tasks);
     std::swap(_timer_tasks, other._timer_tasks);
+    std::swap(_timer_index, other._timer_index);
 
     return *this;
   }
@@ -93,14 +101,10 @@ public:
   void pushDelayed(std::pair<__time_point, __task> &&task) {
     std::lock_guard lg(_task_mutex);
 
-    auto it = _timer_tasks.cbegin();
-    for(; it < _timer_tasks.cend(); ++it) {
-      if(std::get<0>(*it) < task.first) {
-        break;
-      }
-    }
+    _timer_tasks.emplace_back(std::move(task));
 
-    _timer_tasks.emplace(it, task.first, std::move(task.second));
+    _timer_place(_timer_tasks.size() - 1);
+    _timer_up(_timer_tasks.size() - 1);
   }
 
   /**
@@ -144,60 +148,40 @@ public:
   void delay(task_id_t task_id, std::chrono::duration<X, Y> duration) {
     std::lock_guard<std::mutex> lg(_task_mutex);
 
-    auto it = _timer_tasks.begin();
-    for(; it < _timer_tasks.cend(); ++it) {
-      const __task &task = std::get<1>(*it);
-
-      if(&*task == task_id) {
-        std::get<0>(*it) = std::chrono::steady_clock::now() + duration;
-
-        break;
-      }
-    }
-
-    if(it == _timer_tasks.cend()) {
+    auto it = _timer_index.find(task_id);
+    if(it == std::end(_timer_index)) {
       return;
     }
 
-    // smaller time goes to the back
-    auto prev = it - 1;
-    while(it > _timer_tasks.cbegin()) {
-      if(std::get<0>(*it) > std::get<0>(*prev)) {
-        std::swap(*it, *prev);
-      }
+    auto pos = it->second;
 
-      --prev;
-      --it;
-    }
+    std::get<0>(_timer_tasks[pos]) = std::chrono::steady_clock::now() + duration;
+
+    _timer_down(_timer_up(pos));
   }
 
   bool cancel(task_id_t task_id) {
     std::lock_guard lg(_task_mutex);
 
-    auto it = _timer_tasks.begin();
-    for(; it < _timer_tasks.cend(); ++it) {
-      const __task &task = std::get<1>(*it);
-
-      if(&*task == task_id) {
-        _timer_tasks.erase(it);
-
-        return true;
-      }
+    auto it = _timer_index.find(task_id);
+    if(it == std::end(_timer_index)) {
+      return false;
     }
 
-    return false;
+    _timer_erase(it->second);
+
+    return true;
   }
 
   std::optional<std::pair<__time_point, __task>> pop(task_id_t task_id) {
     std::lock_guard lg(_task_mutex);
 
-    auto pos = std::find_if(std::begin(_timer_tasks), std::end(_timer_tasks), [&task_id](const auto &t) { return t.second.get() == task_id; });
-
-    if(pos == std::end(_timer_tasks)) {
+    auto it = _timer_index.find(task_id);
+    if(it == std::end(_timer_index)) {
       return std::nullopt;
     }
 
-    return std::move(*pos);
+    return _timer_erase(it->second);
   }
 
   std::optional<__task> pop() {
@@ -209,11 +193,8 @@ public:
       return std::move(task);
     }
 
-    if(!_timer_tasks.empty() && std::get<0>(_timer_tasks.back()) <= std::chrono::steady_clock::now()) {
-      __task task = std::move(std::get<1>(_timer_tasks.back()));
-      _timer_tasks.pop_back();
-
-      return std::move(task);
+    if(!_timer_tasks.empty() && std::get<0>(_timer_tasks.front()) <= std::chrono::steady_clock::now()) {
+      return std::move(std::get<1>(_timer_erase(0)));
     }
 
     return std::nullopt;
@@ -222,7 +203,7 @@ public:
   bool ready() {
     std::lock_guard<std::mutex> lg(_task_mutex);
 
-    return !_tasks.empty() || (!_timer_tasks.empty() && std::get<0>(_timer_tasks.back()) <= std::chrono::steady_clock::now());
+    return !_tasks.empty() || (!_timer_tasks.empty() && std::get<0>(_timer_tasks.front()) <= std::chrono::steady_clock::now());
   }
 
   std::optional<__time_point> next() {
@@ -232,14 +213,83 @@ public:
       return std::nullopt;
     }
 
-    return std::get<0>(_timer_tasks.back());
+    return std::get<0>(_timer_tasks.front());
   }
 
-private:
+protected:
   template<class Function>
   std::unique_ptr<_ImplBase> toRunnable(Function &&f) {
     return std::make_unique<_Impl<Function>>(std::forward<Function &&>(f));
   }
+
+private:
+  // The functions below are called with _task_mutex held
+
+  void _timer_place(std::size_t pos) {
+    _timer_index[std::get<1>(_timer_tasks[pos]).get()] = pos;
+  }
+
+  void _timer_swap(std::size_t l, std::size_t r) {
+    std::swap(_timer_tasks[l], _timer_tasks[r]);
+
+    _timer_place(l);
+    _timer_place(r);
+  }
+
+  /**
+   * @return The new position of the task
+   */
+  std::size_t _timer_up(std::size_t pos) {
+    while(pos > 0) {
+      auto parent = (pos - 1) / 2;
+      if(!(std::get<0>(_timer_tasks[pos]) < std::get<0>(_timer_tasks[parent]))) {
+        break;
+      }
+
+      _timer_swap(pos, parent);
+      pos = parent;
+    }
+
+    return pos;
+  }
+
+  void _timer_down(std::size_t pos) {
+    while(true) {
+      auto child = pos * 2 + 1;
+      if(child >= _timer_tasks.size()) {
+        break;
+      }
+
+      if(child + 1 < _timer_tasks.size() && std::get<0>(_timer_tasks[child + 1]) < std::get<0>(_timer_tasks[child])) {
+        ++child;
+      }
+
+      if(!(std::get<0>(_timer_tasks[child]) < std::get<0>(_timer_tasks[pos]))) {
+        break;
+      }
+
+      _timer_swap(pos, child);
+      pos = child;
+    }
+  }
+
+  std::pair<__time_point, __task> _timer_erase(std::size_t pos) {
+    auto last = _timer_tasks.size() - 1;
+    if(pos != last) {
+      _timer_swap(pos, last);
+    }
+
+    auto task = std::move(_timer_tasks.back());
+    _timer_tasks.pop_back();
+    _timer_index.erase(std::get<1>(task).get());
+
+    // The task that took its place may belong either above or below it
+    if(pos < _timer_tasks.size()) {
+      _timer_down(_timer_up(pos));
+    }
+
+    return task;
+  }
 };
 } // namespace util
 #endif
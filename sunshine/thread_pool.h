@@ -2,32 +2,79 @@
 #define KITTY_THREAD_POOL_H
 
 #include "task_pool.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <thread>
 
 namespace util {
+enum class priority_e : int {
+  high,   // Work a user notices right away, like input
+  normal, // Default
+  low,    // Housekeeping
+};
+
+constexpr std::size_t PRIORITIES = 3;
+
 /*
  * Allow threads to execute unhindered
  * while keeping full controll over the threads.
+ *
+ * Each thread has its own queue for every priority, and steals from the queues of
+ * the other threads when its own are empty.
+ * High priority tasks run first, then timers that are due, then everything else.
  */
 class ThreadPool : public TaskPool {
 public:
   typedef TaskPool::__task __task;
 
+  // How long tasks of a priority waited before a thread picked them up
+  struct delay_stats_t {
+    std::uint64_t tasks;
+    std::chrono::nanoseconds total;
+    std::chrono::nanoseconds max;
+  };
+
 private:
+  struct queued_t {
+    __time_point queued;
+    __task task;
+  };
+
+  struct worker_t {
+    std::mutex lock;
+    std::array<std::deque<queued_t>, PRIORITIES> tasks;
+  };
+
+  struct stats_t {
+    std::atomic<std::uint64_t> tasks;
+    std::atomic<std::int64_t> total;
+    std::atomic<std::int64_t> max;
+  };
+
   std::vector<std::thread> _thread;
+  std::vector<std::unique_ptr<worker_t>> _workers;
+
+  // The number of tasks waiting in the queues of all workers
+  std::array<std::atomic<int>, PRIORITIES> _queued {};
+  std::array<stats_t, PRIORITIES> _stats {};
+
+  // Tasks pushed from outside the pool are spread over the workers round robin
+  std::atomic<std::size_t> _next_worker { 0 };
 
   std::condition_variable _cv;
   std::mutex _lock;
 
   bool _continue;
 
+  // The pool and worker the current thread belongs to
+  inline static thread_local std::pair<ThreadPool *, std::size_t> _current { nullptr, 0 };
+
 public:
   ThreadPool() : _continue { false } {}
 
-  explicit ThreadPool(int threads) : _thread(threads), _continue { true } {
-    for(auto &t : _thread) {
-      t = std::thread(&ThreadPool::_main, this);
-    }
+  explicit ThreadPool(int threads) : _continue { false } {
+    start(threads);
   }
 
   ~ThreadPool() noexcept {
@@ -39,10 +86,44 @@ public:
 
   template<class Function, class... Args>
   auto push(Function &&newTask, Args &&...args) {
-    std::lock_guard lg(_lock);
-    auto future = TaskPool::push(std::forward<Function>(newTask), std::forward<Args>(args)...);
+    return push(priority_e::normal, std::forward<Function>(newTask), std::forward<Args>(args)...);
+  }
 
+  template<class Function, class... Args>
+  auto push(priority_e priority, Function &&newTask, Args &&...args) {
+    static_assert(std::is_invocable_v<Function, Args &&...>, "arguments don't match the function");
+
+    using __return = std::invoke_result_t<Function, Args &&...>;
+    using task_t   = std::packaged_task<__return()>;
+
+    auto bind = [task = std::forward<Function>(newTask), tuple_args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+      return std::apply(task, std::move(tuple_args));
+    };
+
+    task_t task(std::move(bind));
+
+    auto future = task.get_future();
+
+    if(_workers.empty()) {
+      std::lock_guard lg(_task_mutex);
+      _tasks.emplace_back(toRunnable(std::move(task)));
+
+      return future;
+    }
+
+    // A task pushed from within the pool is likely to be related to the task that pushed it
+    auto index = _current.first == this ? _current.second : _next_worker++ % _workers.size();
+
+    auto &worker = *_workers[index];
+    {
+      std::lock_guard lg(worker.lock);
+      worker.tasks[(int)priority].emplace_back(queued_t { std::chrono::steady_clock::now(), toRunnable(std::move(task)) });
+    }
+    ++_queued[(int)priority];
+
+    std::lock_guard lg(_lock);
     _cv.notify_one();
+
     return future;
   }
 
@@ -62,13 +143,26 @@ public:
     return future;
   }
 
+  template<class X, class Y>
+  void delay(task_id_t task_id, std::chrono::duration<X, Y> duration) {
+    std::lock_guard lg(_lock);
+    TaskPool::delay(task_id, duration);
+
+    // The task may now be due before the time the threads are waiting for
+    _cv.notify_all();
+  }
+
   void start(int threads) {
     _continue = true;
 
-    _thread.resize(threads);
+    _workers.resize(threads);
+    for(auto &worker : _workers) {
+      worker = std::make_unique<worker_t>();
+    }
 
-    for(auto &t : _thread) {
-      t = std::thread(&ThreadPool::_main, this);
+    _thread.resize(threads);
+    for(int x = 0; x < threads; ++x) {
+      _thread[x] = std::thread(&ThreadPool::_main, this, x);
     }
   }
 
@@ -85,16 +179,28 @@ public:
     }
   }
 
+  delay_stats_t delay_stats(priority_e priority) const {
+    auto &stats = _stats[(int)priority];
+
+    return {
+      stats.tasks.load(),
+      std::chrono::nanoseconds { stats.total.load() },
+      std::chrono::nanoseconds { stats.max.load() }
+    };
+  }
+
 public:
-  void _main() {
+  void _main(std::size_t index) {
+    _current = { this, index };
+
     while(_continue) {
-      if(auto task = this->pop()) {
+      if(auto task = _pop(index)) {
         (*task)->run();
       }
       else {
         std::unique_lock uniq_lock(_lock);
 
-        if(ready()) {
+        if(_pending()) {
           continue;
         }
 
@@ -112,10 +218,147 @@ public:
     }
 
     // Execute remaining tasks
-    while(auto task = this->pop()) {
+    while(auto task = _pop(index)) {
       (*task)->run();
     }
   }
+
+private:
+  std::optional<__task> _pop(std::size_t index) {
+    if(auto task = _pop(index, priority_e::high)) {
+      return task;
+    }
+
+    // Tasks pushed before the pool started, and timers that are due
+    if(auto task = TaskPool::pop()) {
+      return task;
+    }
+
+    if(auto task = _pop(index, priority_e::normal)) {
+      return task;
+    }
+
+    return _pop(index, priority_e::low);
+  }
+
+  std::optional<__task> _pop(std::size_t index, priority_e priority) {
+    if(!_queued[(int)priority].load()) {
+      return std::nullopt;
+    }
+
+    // Start with the queue of this thread, then steal from the others
+    for(std::size_t x = 0; x < _workers.size(); ++x) {
+      auto &worker = *_workers[(index + x) % _workers.size()];
+
+      std::unique_lock ul(worker.lock);
+
+      auto &tasks = worker.tasks[(int)priority];
+      if(tasks.empty()) {
+        continue;
+      }
+
+      auto queued = std::move(tasks.front());
+      tasks.pop_front();
+
+      ul.unlock();
+
+      --_queued[(int)priority];
+
+      _record(priority, std::chrono::steady_clock::now() - queued.queued);
+
+      return std::move(queued.task);
+    }
+
+    return std::nullopt;
+  }
+
+  bool _pending() {
+    for(auto &queued : _queued) {
+      if(queued.load()) {
+        return true;
+      }
+    }
+
+    return ready();
+  }
+
+  void _record(priority_e priority, std::chrono::nanoseconds delay) {
+    auto &stats = _stats[(int)priority];
+
+    ++stats.tasks;
+    stats.total += delay.count();
+
+    auto max = stats.max.load();
+    while(delay.count() > max && !stats.max.compare_exchange_weak(max, delay.count())) {}
+  }
+};
+
+/**
+ * Runs the tasks pushed to it on a ThreadPool one at a time, in the order they were pushed
+ * Other tasks of the pool may run in between, on any of its threads.
+ */
+class strand_t : public std::enable_shared_from_this<strand_t> {
+public:
+  typedef TaskPool::__task __task;
+
+  strand_t(ThreadPool &pool, priority_e priority) : _pool { pool }, _priority { priority }, _running { false } {}
+
+  template<class Function, class... Args>
+  void push(Function &&newTask, Args &&...args) {
+    static_assert(std::is_invocable_v<Function, Args &&...>, "arguments don't match the function");
+
+    auto bind = [task = std::forward<Function>(newTask), tuple_args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+      std::apply(task, std::move(tuple_args));
+    };
+
+    std::lock_guard lg(_lock);
+    _tasks.emplace_back(std::make_unique<_Impl<decltype(bind)>>(std::move(bind)));
+
+    if(!_running) {
+      _running = true;
+
+      _schedule();
+    }
+  }
+
+private:
+  // After this many tasks, the strand goes to the back of the queue
+  static constexpr int BATCH_SIZE = 16;
+
+  void _schedule() {
+    _pool.push(_priority, [self = shared_from_this()]() {
+      self->_run();
+    });
+  }
+
+  void _run() {
+    for(int x = 0; x < BATCH_SIZE; ++x) {
+      __task task;
+      {
+        std::lock_guard lg(_lock);
+
+        if(_tasks.empty()) {
+          _running = false;
+
+          return;
+        }
+
+        task = std::move(_tasks.front());
+        _tasks.pop_front();
+      }
+
+      task->run();
+    }
+
+    _schedule();
+  }
+
+  ThreadPool &_pool;
+  priority_e _priority;
+
+  std::mutex _lock;
+  std::deque<__task> _tasks;
+  bool _running;
 };
 } // namespace util
 #endif
@@ -5,128 +5,284 @@
 #ifndef SUNSHINE_THREAD_SAFE_H
 #define SUNSHINE_THREAD_SAFE_H
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <climits>
 #include <condition_variable>
 #include <functional>
-#include <map>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include "utility.h"
 
 namespace safe {
-template<class T>
-class event_t {
+/**
+ * A counter threads can sleep on until it moves on from the value they last saw
+ * On Linux, sleeping and waking is a futex, elsewhere it falls back to a condition variable
+ */
+class futex_t {
 public:
-  using status_t = util::optional_t<T>;
+  /**
+   * Move the counter on and wake every thread sleeping on it
+   */
+  void bump() {
+    _value.fetch_add(1);
+
+    // Only the first bump after a thread went to sleep pays for the syscall
+    if(_sleepers.exchange(false)) {
+      wake_all();
+    }
+  }
 
-  template<class... Args>
-  void raise(Args &&...args) {
-    std::lock_guard lg { _lock };
-    if(!_continue) {
+  /**
+   * Sleep until ready() returns true
+   */
+  template<class F>
+  void wait(F &&ready) {
+    if(spin(ready)) {
       return;
     }
 
-    if constexpr(std::is_same_v<std::optional<T>, status_t>) {
-      _status = std::make_optional<T>(std::forward<Args>(args)...);
+    // The counter is read before ready(), so a bump in between makes sleep() return right away
+    while(true) {
+      _sleepers.store(true);
+
+      auto seen = _value.load();
+      if(ready()) {
+        return;
+      }
+
+      sleep(seen, nullptr);
+    }
+  }
+
+  /**
+   * Sleep until ready() returns true
+   * @return false if delay passed first
+   */
+  template<class F, class Rep, class Period>
+  bool wait_for(F &&ready, std::chrono::duration<Rep, Period> delay) {
+    if(spin(ready)) {
+      return true;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + delay;
+    while(true) {
+      _sleepers.store(true);
+
+      auto seen = _value.load();
+      if(ready()) {
+        return true;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if(now >= deadline) {
+        return false;
+      }
+
+      std::chrono::nanoseconds timeout = deadline - now;
+      sleep(seen, &timeout);
+    }
+  }
+
+private:
+  // Waking a sleeping thread costs far more than checking a few more times
+  static constexpr int SPIN_COUNT = 64;
+
+  template<class F>
+  static bool spin(F &ready) {
+    for(int x = 0; x < SPIN_COUNT; ++x) {
+      if(ready()) {
+        return true;
+      }
+
+      std::this_thread::yield();
+    }
+
+    return false;
+  }
+
+#ifdef __linux__
+  void sleep(std::uint32_t seen, const std::chrono::nanoseconds *timeout) {
+    timespec ts;
+    if(timeout) {
+      ts.tv_sec  = timeout->count() / 1000000000;
+      ts.tv_nsec = timeout->count() % 1000000000;
+    }
+
+    // Returns right away if the counter no longer holds seen
+    syscall(SYS_futex, (std::uint32_t *)&_value, FUTEX_WAIT_PRIVATE, seen, timeout ? &ts : nullptr, nullptr, 0);
+  }
+
+  void wake_all() {
+    syscall(SYS_futex, (std::uint32_t *)&_value, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+  }
+#else
+  void sleep(std::uint32_t seen, const std::chrono::nanoseconds *timeout) {
+    std::unique_lock ul { _lock };
+
+    auto moved = [&]() { return _value.load() != seen; };
+    if(timeout) {
+      _cv.wait_for(ul, *timeout, moved);
     }
     else {
-      _status = status_t { std::forward<Args>(args)... };
+      _cv.wait(ul, moved);
     }
+  }
+
+  void wake_all() {
+    // A sleeper either sees the new value or is already waiting on _cv
+    { std::lock_guard lg { _lock }; }
 
     _cv.notify_all();
   }
 
-  // pop and view shoud not be used interchangebly
-  status_t pop() {
-    std::unique_lock ul { _lock };
+  std::mutex _lock;
+  std::condition_variable _cv;
+#endif
 
-    if(!_continue) {
-      return util::false_v<status_t>;
+  std::atomic<std::uint32_t> _value { 0 };
+  std::atomic_bool _sleepers { false };
+};
+
+/**
+ * Hands a value from one thread to the threads waiting on it
+ *
+ * peek() and running() are a single load, so hot loops may check an event every iteration.
+ * Waiting threads sleep on a futex, raise() only wakes them when there are any.
+ */
+template<class T>
+class event_t {
+public:
+  using status_t = util::optional_t<T>;
+
+  template<class... Args>
+  void raise(Args &&...args) {
+    {
+      std::lock_guard lg { _lock };
+      if(_state.load(std::memory_order_relaxed) & STOPPED) {
+        return;
+      }
+
+      if constexpr(std::is_same_v<std::optional<T>, status_t>) {
+        _status = std::make_optional<T>(std::forward<Args>(args)...);
+      }
+      else {
+        _status = status_t { std::forward<Args>(args)... };
+      }
+
+      _state.fetch_or(RAISED, std::memory_order_release);
     }
 
-    while(!_status) {
-      _cv.wait(ul);
+    _changed.bump();
+  }
 
-      if(!_continue) {
+  // pop and view shoud not be used interchangebly
+  status_t pop() {
+    while(true) {
+      _changed.wait([this]() { return _state.load(std::memory_order_acquire) != 0; });
+
+      std::lock_guard lg { _lock };
+      if(auto val = take()) {
+        return val;
+      }
+
+      if(_state.load(std::memory_order_relaxed) & STOPPED) {
         return util::false_v<status_t>;
       }
     }
-
-    auto val = std::move(_status);
-    _status  = util::false_v<status_t>;
-    return val;
   }
 
   // pop and view shoud not be used interchangebly
   template<class Rep, class Period>
   status_t pop(std::chrono::duration<Rep, Period> delay) {
-    std::unique_lock ul { _lock };
+    auto deadline = std::chrono::steady_clock::now() + delay;
+    auto ready    = [this]() { return _state.load(std::memory_order_acquire) != 0; };
 
-    if(!_continue) {
-      return util::false_v<status_t>;
-    }
+    while(_changed.wait_for(ready, deadline - std::chrono::steady_clock::now())) {
+      std::lock_guard lg { _lock };
+      if(auto val = take()) {
+        return val;
+      }
 
-    while(!_status) {
-      if(!_continue || _cv.wait_for(ul, delay) == std::cv_status::timeout) {
-        return util::false_v<status_t>;
+      if(_state.load(std::memory_order_relaxed) & STOPPED) {
+        break;
       }
     }
 
-    auto val = std::move(_status);
-    _status  = util::false_v<status_t>;
-    return val;
+    return util::false_v<status_t>;
   }
 
   // pop and view shoud not be used interchangebly
   const status_t &view() {
-    std::unique_lock ul { _lock };
+    _changed.wait([this]() { return _state.load(std::memory_order_acquire) != 0; });
 
-    if(!_continue) {
+    if(_state.load(std::memory_order_acquire) & STOPPED) {
       return util::false_v<status_t>;
     }
 
-    while(!_status) {
-      _cv.wait(ul);
-
-      if(!_continue) {
-        return util::false_v<status_t>;
-      }
-    }
-
+    // Once raised, the status is only replaced by another raise()
     return _status;
   }
 
   bool peek() {
-    return _continue && (bool)_status;
+    return _state.load(std::memory_order_acquire) == RAISED;
   }
 
   void stop() {
-    std::lock_guard lg { _lock };
-
-    _continue = false;
+    _state.fetch_or(STOPPED, std::memory_order_release);
 
-    _cv.notify_all();
+    _changed.bump();
   }
 
   void reset() {
     std::lock_guard lg { _lock };
 
-    _continue = true;
-
     _status = util::false_v<status_t>;
+
+    _state.store(0, std::memory_order_release);
   }
 
   [[nodiscard]] bool running() const {
-    return _continue;
+    return !(_state.load(std::memory_order_acquire) & STOPPED);
   }
 
 private:
-  bool _continue { true };
+  static constexpr std::uint32_t RAISED  = 1;
+  static constexpr std::uint32_t STOPPED = 2;
+
+  // Called with _lock held
+  status_t take() {
+    auto state = _state.load(std::memory_order_relaxed);
+    if(state != RAISED) {
+      return util::false_v<status_t>;
+    }
+
+    auto val = std::move(_status);
+    _status  = util::false_v<status_t>;
+
+    _state.fetch_and(~RAISED, std::memory_order_relaxed);
+
+    return val;
+  }
+
+  std::atomic<std::uint32_t> _state { 0 };
   status_t _status { util::false_v<status_t> };
 
-  std::condition_variable _cv;
   std::mutex _lock;
+  futex_t _changed;
 };
 
 template<class T>
@@ -216,99 +372,263 @@ alarm_t<T> make_alarm() {
   return std::make_shared<alarm_raw_t<T>>();
 }
 
-template<class T>
+enum class overflow_e : int {
+  clear,       // Make room by dropping every element in the queue
+  flush,       // Drop every element in the queue, as well as the element that doesn't fit
+  block,       // Wait for room
+  drop_newest, // Drop the element that doesn't fit
+};
+
+enum class producer_e : int {
+  multi,  // Any thread may raise
+  single, // Only one thread at a time raises
+};
+
+/**
+ * A bounded ring buffer
+ *
+ * Raising and popping don't take a lock, a thread only sleeps when it has to wait.
+ * Elements may be popped from any thread, since overflow_e::clear and overflow_e::flush
+ * drop elements from the raising thread.
+ * With producer_e::single, claiming a slot for a new element is a plain store instead of a CAS.
+ */
+template<class T, producer_e producer = producer_e::multi>
 class queue_t {
 public:
   using status_t = util::optional_t<T>;
 
-  queue_t(std::uint32_t max_elements) : _max_elements { max_elements } {}
+  // Called by the raising thread for every element dropped because the queue was full
+  using drop_f = std::function<void(T &)>;
+
+  queue_t(std::uint32_t max_elements, overflow_e overflow = overflow_e::clear, drop_f on_drop = nullptr)
+      : _max_elements { std::max<std::uint32_t>(max_elements, 1) },
+        _overflow { overflow },
+        _on_drop { std::move(on_drop) },
+        _cells { new cell_t[_max_elements] } {
+    for(std::uint32_t x = 0; x < _max_elements; ++x) {
+      _cells[x].seq.store(x, std::memory_order_relaxed);
+    }
+  }
+
+  queue_t(const queue_t &) = delete;
+  queue_t &operator=(const queue_t &) = delete;
+
+  ~queue_t() {
+    std::optional<T> val;
+    while(try_pop(val)) {}
+  }
 
   template<class... Args>
   void raise(Args &&...args) {
-    std::lock_guard ul { _lock };
-
     if(!_continue) {
       return;
     }
 
-    if(_queue.size() == _max_elements) {
-      _queue.clear();
+    std::vector<T> dropped;
+    while(!try_push(std::forward<Args>(args)...)) {
+      switch(_overflow) {
+      case overflow_e::clear:
+        drain(dropped);
+        continue;
+      case overflow_e::flush:
+        drain(dropped);
+        dropped.emplace_back(std::forward<Args>(args)...);
+        break;
+      case overflow_e::block:
+        _popped.wait([&]() {
+          return !_continue || try_push(std::forward<Args>(args)...);
+        });
+
+        if(!_continue) {
+          return;
+        }
+
+        _pushed.bump();
+        return;
+      case overflow_e::drop_newest:
+        dropped.emplace_back(std::forward<Args>(args)...);
+        break;
+      }
+
+      break;
     }
 
-    _queue.emplace_back(std::forward<Args>(args)...);
+    if(dropped.empty() || _overflow == overflow_e::clear) {
+      _pushed.bump();
+    }
 
-    _cv.notify_all();
+    if(_on_drop) {
+      for(auto &el : dropped) {
+        _on_drop(el);
+      }
+    }
   }
 
   bool peek() {
-    return _continue && !_queue.empty();
+    if(!_continue) {
+      return false;
+    }
+
+    auto pos = _head.load(std::memory_order_relaxed);
+    return _cells[pos % _max_elements].seq.load(std::memory_order_acquire) == pos + 1;
   }
 
   template<class Rep, class Period>
   status_t pop(std::chrono::duration<Rep, Period> delay) {
-    std::unique_lock ul { _lock };
+    std::optional<T> val;
+    auto ready = [&]() {
+      return !_continue || try_pop(val);
+    };
 
-    if(!_continue) {
-      return util::false_v<status_t>;
-    }
+    _pushed.wait_for(ready, delay);
 
-    while(_queue.empty()) {
-      if(!_continue || _cv.wait_for(ul, delay) == std::cv_status::timeout) {
-        return util::false_v<status_t>;
-      }
-    }
+    return take(val);
+  }
 
-    auto val = std::move(_queue.front());
-    _queue.erase(std::begin(_queue));
+  status_t pop() {
+    std::optional<T> val;
+    _pushed.wait([&]() {
+      return !_continue || try_pop(val);
+    });
 
-    return val;
+    return take(val);
   }
 
-  status_t pop() {
-    std::unique_lock ul { _lock };
+  /**
+   * Take the elements still in the queue, e.g. to stop them after the queue itself was stopped
+   */
+  std::vector<T> unsafe() {
+    std::vector<T> elements;
+    drain(elements);
 
-    if(!_continue) {
-      return util::false_v<status_t>;
+    return elements;
+  }
+
+  void stop() {
+    _continue = false;
+
+    _pushed.bump();
+    _popped.bump();
+  }
+
+  [[nodiscard]] bool running() const {
+    return _continue;
+  }
+
+  // Only a snapshot while other threads raise and pop
+  std::size_t size() const {
+    auto head = _head.load(std::memory_order_relaxed);
+    auto tail = _tail.load(std::memory_order_relaxed);
+
+    return tail > head ? tail - head : 0;
+  }
+
+private:
+  struct cell_t {
+    // pos when free for the element at pos, pos + 1 once that element is in place
+    std::atomic<std::uint64_t> seq;
+
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T *get() {
+      return std::launder(reinterpret_cast<T *>(storage));
     }
+  };
 
-    while(_queue.empty()) {
-      _cv.wait(ul);
+  template<class... Args>
+  bool try_push(Args &&...args) {
+    auto pos = _tail.load(std::memory_order_relaxed);
+    while(true) {
+      auto &cell = _cells[pos % _max_elements];
+      auto diff  = (std::int64_t)(cell.seq.load(std::memory_order_acquire) - pos);
+
+      if(diff < 0) {
+        // The element max_elements before this one hasn't been popped yet
+        return false;
+      }
 
-      if(!_continue) {
-        return util::false_v<status_t>;
+      if(diff > 0) {
+        pos = _tail.load(std::memory_order_relaxed);
+        continue;
       }
-    }
 
-    auto val = std::move(_queue.front());
-    _queue.erase(std::begin(_queue));
+      if constexpr(producer == producer_e::single) {
+        _tail.store(pos + 1, std::memory_order_relaxed);
+      }
+      else if(!_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        continue;
+      }
 
-    return val;
-  }
+      new(cell.storage) T(std::forward<Args>(args)...);
+      cell.seq.store(pos + 1, std::memory_order_release);
 
-  std::vector<T> &unsafe() {
-    return _queue;
+      return true;
+    }
   }
 
-  void stop() {
-    std::lock_guard lg { _lock };
+  bool try_pop(std::optional<T> &val) {
+    auto pos = _head.load(std::memory_order_relaxed);
+    while(true) {
+      auto &cell = _cells[pos % _max_elements];
+      auto diff  = (std::int64_t)(cell.seq.load(std::memory_order_acquire) - (pos + 1));
 
-    _continue = false;
+      if(diff < 0) {
+        // Empty, or the element is still being put in place
+        return false;
+      }
 
-    _cv.notify_all();
+      if(diff > 0) {
+        pos = _head.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if(!_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        continue;
+      }
+
+      auto el = cell.get();
+      val.emplace(std::move(*el));
+      el->~T();
+
+      cell.seq.store(pos + _max_elements, std::memory_order_release);
+
+      return true;
+    }
   }
 
-  [[nodiscard]] bool running() const {
-    return _continue;
+  void drain(std::vector<T> &elements) {
+    std::optional<T> val;
+    while(try_pop(val)) {
+      elements.emplace_back(std::move(*val));
+    }
+
+    _popped.bump();
   }
 
-private:
-  bool _continue { true };
+  status_t take(std::optional<T> &val) {
+    if(!val) {
+      return util::false_v<status_t>;
+    }
+
+    _popped.bump();
+
+    return std::move(*val);
+  }
+
+  std::atomic_bool _continue { true };
   std::uint32_t _max_elements;
 
-  std::mutex _lock;
-  std::condition_variable _cv;
+  overflow_e _overflow;
+  drop_f _on_drop;
+
+  std::unique_ptr<cell_t[]> _cells;
+
+  // Consumers and producers each get their own cache line
+  alignas(64) std::atomic<std::uint64_t> _head { 0 };
+  alignas(64) std::atomic<std::uint64_t> _tail { 0 };
 
-  std::vector<T> _queue;
+  futex_t _pushed;
+  futex_t _popped;
 };
 
 template<class T>
@@ -409,7 +729,7 @@ private:
   construct_f _construct;
   destruct_f _destruct;
 
-  std::array<std::uint8_t, sizeof(element_type)> _object_buf;
+  alignas(element_type) std::array<std::uint8_t, sizeof(element_type)> _object_buf;
 
   std::uint32_t _count;
   std::mutex _lock;
@@ -441,10 +761,22 @@ public:
   }
 };
 
-template<class T>
-inline auto lock(const std::weak_ptr<void> &wp) {
-  return std::reinterpret_pointer_cast<typename T::element_type>(wp.lock());
-}
+// The number of mail ids a mail_raw_t has room for
+constexpr std::size_t MAX_MAIL = 16;
+
+/**
+ * Identifies a post in a mail_raw_t
+ * P is the type of the post, so a mismatch between sender and receiver doesn't compile
+ * I is the slot of the post, ids are listed in main.h
+ */
+template<class P, std::size_t I>
+struct mail_id_t {
+  static_assert(I < MAX_MAIL, "Increase safe::MAX_MAIL");
+
+  using post_type = P;
+
+  static constexpr std::size_t index = I;
+};
 
 class mail_raw_t : public std::enable_shared_from_this<mail_raw_t> {
 public:
@@ -454,53 +786,48 @@ public:
   template<class T>
   using queue_t = std::shared_ptr<post_t<queue_t<T>>>;
 
-  template<class T>
-  event_t<T> event(const std::string_view &id) {
-    std::lock_guard lg { mutex };
-
-    auto it = id_to_post.find(id);
-    if(it != std::end(id_to_post)) {
-      return lock<event_t<T>>(it->second);
-    }
-
-    auto post = std::make_shared<typename event_t<T>::element_type>(shared_from_this());
-    id_to_post.emplace(std::pair<std::string, std::weak_ptr<void>> { std::string { id }, post });
-
-    return post;
+  template<class T, std::size_t I>
+  event_t<T> event(mail_id_t<safe::event_t<T>, I>) {
+    return post<event_t<T>>(I);
   }
 
-  template<class T>
-  queue_t<T> queue(const std::string_view &id) {
-    std::lock_guard lg { mutex };
-
-    auto it = id_to_post.find(id);
-    if(it != std::end(id_to_post)) {
-      return lock<queue_t<T>>(it->second);
-    }
-
-    auto post = std::make_shared<typename queue_t<T>::element_type>(shared_from_this(), 32);
-    id_to_post.emplace(std::pair<std::string, std::weak_ptr<void>> { std::string { id }, post });
-
-    return post;
+  template<class T, std::size_t I>
+  queue_t<T> queue(mail_id_t<safe::queue_t<T>, I>) {
+    return post<queue_t<T>>(I, 32);
   }
 
+  /**
+   * Forget every post that has been destroyed
+   */
   void cleanup() {
     std::lock_guard lg { mutex };
 
-    for(auto it = std::begin(id_to_post); it != std::end(id_to_post); ++it) {
-      auto &weak = it->second;
-
+    for(auto &weak : slots) {
       if(weak.expired()) {
-        id_to_post.erase(it);
-
-        return;
+        weak.reset();
       }
     }
   }
 
   std::mutex mutex;
 
-  std::map<std::string, std::weak_ptr<void>, std::less<>> id_to_post;
+  std::array<std::weak_ptr<void>, MAX_MAIL> slots;
+
+private:
+  template<class P, class... Args>
+  P post(std::size_t index, Args &&...args) {
+    std::lock_guard lg { mutex };
+
+    auto &weak = slots[index];
+    if(auto post = weak.lock()) {
+      return std::static_pointer_cast<typename P::element_type>(post);
+    }
+
+    auto post = std::make_shared<typename P::element_type>(shared_from_this(), std::forward<Args>(args)...);
+    weak      = post;
+
+    return post;
+  }
 };
 
 inline void cleanup(mail_raw_t *mail) {
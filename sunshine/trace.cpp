@@ -0,0 +1,167 @@
+//
+// Records spans of the streaming pipeline into a buffer per thread
+//
+
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "main.h"
+#include "trace.h"
+
+namespace trace {
+using namespace std::literals;
+
+struct event_t {
+  const char *category;
+  const char *name;
+  time_point start;
+  time_point end;
+};
+
+/**
+ * Only its own thread appends to a buffer, dump() reads the events it has published so far
+ */
+struct buffer_t {
+  // A little over a minute of every span a video thread records at 120 fps
+  static constexpr std::size_t MAX_EVENTS = 32768;
+
+  explicit buffer_t(int tid) : tid { tid }, events(MAX_EVENTS), size { 0 }, generation { 0 }, dropped { 0 } {}
+
+  const int tid;
+
+  std::vector<event_t> events;
+  std::atomic<std::size_t> size;
+
+  // The recording the events belong to
+  std::atomic<std::uint64_t> generation;
+
+  // Events that didn't fit
+  std::atomic<std::uint64_t> dropped;
+};
+
+static std::mutex lock;
+static std::vector<std::shared_ptr<buffer_t>> buffers;
+static int next_tid = 1;
+
+// Bumped by every new recording, threads reset their buffer when they notice
+static std::atomic<std::uint64_t> generation { 0 };
+
+static buffer_t &this_thread_buffer() {
+  thread_local std::shared_ptr<buffer_t> buffer;
+
+  if(!buffer) {
+    std::lock_guard lg { lock };
+
+    buffer = std::make_shared<buffer_t>(next_tid++);
+    buffers.emplace_back(buffer);
+  }
+
+  return *buffer;
+}
+
+void enable(bool enable) {
+  std::lock_guard lg { lock };
+
+  if(enable == active.load()) {
+    return;
+  }
+
+  if(enable) {
+    ++generation;
+
+    // Forget the buffers of threads that have exited
+    buffers.erase(std::remove_if(std::begin(buffers), std::end(buffers), [](auto &buffer) {
+      return buffer.use_count() == 1;
+    }),
+      std::end(buffers));
+  }
+
+  active.store(enable);
+
+  BOOST_LOG(info) << (enable ? "Tracing started"sv : "Tracing stopped"sv);
+}
+
+void append(const char *category, const char *name, time_point start, time_point end) {
+  auto &buffer = this_thread_buffer();
+
+  auto current = generation.load(std::memory_order_acquire);
+  if(buffer.generation.load(std::memory_order_relaxed) != current) {
+    buffer.size.store(0, std::memory_order_relaxed);
+    buffer.dropped.store(0, std::memory_order_relaxed);
+
+    // From here on, dump() reads this buffer again
+    buffer.generation.store(current, std::memory_order_release);
+  }
+
+  auto size = buffer.size.load(std::memory_order_relaxed);
+  if(size == buffer.events.size()) {
+    buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+
+    return;
+  }
+
+  buffer.events[size] = event_t { category, name, start, end };
+  buffer.size.store(size + 1, std::memory_order_release);
+}
+
+std::string dump() {
+  std::lock_guard lg { lock };
+
+  auto current = generation.load();
+
+  // Only the buffers written during the last recording
+  std::vector<std::pair<buffer_t *, std::size_t>> recorded;
+  for(auto &buffer : buffers) {
+    if(buffer->generation.load(std::memory_order_acquire) != current) {
+      continue;
+    }
+
+    recorded.emplace_back(buffer.get(), buffer->size.load(std::memory_order_acquire));
+  }
+
+  // Timestamps start at the first event
+  auto epoch = time_point::max();
+  for(auto &[buffer, size] : recorded) {
+    if(size) {
+      epoch = std::min(epoch, buffer->events.front().start);
+    }
+  }
+
+  auto us = [](time_point::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+  };
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+
+  out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+
+  auto separator = ""sv;
+  for(auto &[buffer, size] : recorded) {
+    for(std::size_t x = 0; x < size; ++x) {
+      auto &event = buffer->events[x];
+
+      out << separator
+          << R"({"name":")" << event.name
+          << R"(","cat":")" << event.category
+          << R"(","ph":"X","pid":1,"tid":)" << buffer->tid
+          << R"(,"ts":)" << us(event.start - epoch)
+          << R"(,"dur":)" << us(event.end - event.start) << '}';
+      separator = ","sv;
+    }
+
+    auto dropped = buffer->dropped.load(std::memory_order_relaxed);
+    if(dropped) {
+      BOOST_LOG(warning) << "Trace of thread "sv << buffer->tid << " is missing "sv << dropped << " events, its buffer was full"sv;
+    }
+  }
+
+  out << "]}";
+
+  return out.str();
+}
+} // namespace trace
@@ -0,0 +1,74 @@
+#ifndef SUNSHINE_TRACE_H
+#define SUNSHINE_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace trace {
+using time_point = std::chrono::steady_clock::time_point;
+
+// While disabled, a span costs a single relaxed load
+inline std::atomic_bool active { false };
+
+inline bool enabled() {
+  return active.load(std::memory_order_relaxed);
+}
+
+/**
+ * Start a new recording, discarding the previous one, or stop the current one
+ * The events of a stopped recording are kept until the next one starts.
+ */
+void enable(bool enable);
+
+void append(const char *category, const char *name, time_point start, time_point end);
+
+/**
+ * Record a span the caller already measured
+ * category and name must outlive the recording, string literals do.
+ */
+inline void record(const char *category, const char *name, time_point start, time_point end) {
+  if(enabled()) {
+    append(category, name, start, end);
+  }
+}
+
+/**
+ * Records a span on the current thread, from its construction until end() or its destruction
+ */
+class scope_t {
+public:
+  scope_t(const char *category, const char *name) : _category { category }, _name { name }, _start {} {
+    if(enabled()) {
+      _start = std::chrono::steady_clock::now();
+    }
+  }
+
+  scope_t(const scope_t &) = delete;
+  scope_t &operator=(const scope_t &) = delete;
+
+  ~scope_t() {
+    end();
+  }
+
+  void end() {
+    if(_start != time_point {}) {
+      record(_category, _name, _start, std::chrono::steady_clock::now());
+
+      _start = {};
+    }
+  }
+
+private:
+  const char *_category;
+  const char *_name;
+  time_point _start;
+};
+
+/**
+ * The events of the last recording in the Chrome trace event format, Perfetto opens it as well
+ */
+std::string dump();
+} // namespace trace
+
+#endif
@@ -17,6 +17,8 @@ extern "C" {
 #include "platform/common.h"
 #include "round_robin.h"
 #include "sync.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include "video.h"
 
 #ifdef _WIN32
@@ -352,13 +354,14 @@ public:
 struct sync_session_ctx_t {
   safe::signal_t *join_event;
   safe::mail_raw_t::event_t<bool> shutdown_event;
-  safe::mail_raw_t::queue_t<packet_t> packets;
+  packet_sink_t sink;
   safe::mail_raw_t::event_t<idr_t> idr_events;
   safe::mail_raw_t::event_t<input::touch_port_t> touch_port_events;
 
   config_t config;
   int frame_nr;
   int key_frame_nr;
+  stats::session_t *stats;
   void *channel_data;
 };
 
@@ -618,7 +621,10 @@ void captureThread(
     auto &img = *round_robin++;
     while(img.use_count() > 1) {}
 
+    trace::scope_t span { "video", "snapshot" };
     auto status = disp->snapshot(img.get(), 1000ms, display_cursor);
+    span.end();
+
     switch(status) {
     case platf::capture_e::reinit: {
       reinit_event.raise(true);
@@ -697,7 +703,7 @@ void captureThread(
   }
 }
 
-int encode(int64_t frame_nr, session_t &session, frame_t::pointer frame, safe::mail_raw_t::queue_t<packet_t> &packets, void *channel_data) {
+int encode(int64_t frame_nr, session_t &session, frame_t::pointer frame, packet_sink_t &sink, void *channel_data) {
   frame->pts = frame_nr;
 
   auto &ctx = session.ctx;
@@ -706,7 +712,10 @@ int encode(int64_t frame_nr, session_t &session, frame_t::pointer frame, safe::m
   auto &vps = session.vps;
 
   /* send the frame to the encoder */
+  trace::scope_t span { "video", "avcodec_send_frame" };
   auto ret = avcodec_send_frame(ctx.get(), frame);
+  span.end();
+
   if(ret < 0) {
     char err_str[AV_ERROR_MAX_STRING_SIZE] { 0 };
     BOOST_LOG(error) << "Could not send a frame for encoding: "sv << av_make_error_string(err_str, AV_ERROR_MAX_STRING_SIZE, ret);
@@ -717,7 +726,10 @@ int encode(int64_t frame_nr, session_t &session, frame_t::pointer frame, safe::m
   while(ret >= 0) {
     auto packet = std::make_unique<packet_t::element_type>(nullptr);
 
+    trace::scope_t span { "video", "avcodec_receive_packet" };
     ret = avcodec_receive_packet(ctx.get(), packet.get());
+    span.end();
+
     if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
       return 0;
     }
@@ -752,7 +764,7 @@ int encode(int64_t frame_nr, session_t &session, frame_t::pointer frame, safe::m
 
     packet->replacements = &session.replacements;
     packet->channel_data = channel_data;
-    packets->raise(std::move(packet));
+    sink(std::move(packet));
   }
 
   return 0;
@@ -994,6 +1006,8 @@ void encode_run(
   platf::hwdevice_t *hwdevice,
   safe::signal_t &reinit_event,
   const encoder_t &encoder,
+  packet_sink_t sink,
+  stats::session_t &stats,
   void *channel_data) {
 
   auto session = make_session(encoder, config, width, height, hwdevice);
@@ -1008,7 +1022,6 @@ void encode_run(
   auto frame = session->device->frame;
 
   auto shutdown_event = mail->event<bool>(mail::shutdown);
-  auto packets        = mail::man->queue<packet_t>(mail::video_packets);
   auto idr_events     = mail->event<idr_t>(mail::idr);
 
   while(true) {
@@ -1042,7 +1055,13 @@ void encode_run(
     // When Moonlight request an IDR frame, send frames even if there is no new captured frame
     if(frame_nr > key_frame_nr || images->peek()) {
       if(auto img = images->pop(delay)) {
+        auto start = std::chrono::steady_clock::now();
         session->device->convert(*img);
+        auto end = std::chrono::steady_clock::now();
+
+        stats.add(stats::FRAMES_CAPTURED);
+        stats.observe(stats::CONVERT_TIME, end - start);
+        trace::record("video", "convert", start, end);
       }
       else if(images->running()) {
         continue;
@@ -1052,10 +1071,12 @@ void encode_run(
       }
     }
 
-    if(encode(frame_nr++, *session, frame, packets, channel_data)) {
+    auto start = std::chrono::steady_clock::now();
+    if(encode(frame_nr++, *session, frame, sink, channel_data)) {
       BOOST_LOG(error) << "Could not encode video packet"sv;
       return;
     }
+    stats.observe(stats::ENCODE_TIME, std::chrono::steady_clock::now() - start);
 
     frame->pict_type = AV_PICTURE_TYPE_NONE;
     frame->key_frame = 0;
@@ -1114,6 +1135,23 @@ std::optional<sync_session_t> make_synced_session(platf::display_t *disp, const
   return std::move(encode_session);
 }
 
+int encode_synced(sync_session_t *synced_session) {
+  auto frame = synced_session->session.device->frame;
+  auto ctx   = synced_session->ctx;
+
+  auto start = std::chrono::steady_clock::now();
+  if(encode(ctx->frame_nr++, synced_session->session, frame, ctx->sink, ctx->channel_data)) {
+    BOOST_LOG(error) << "Could not encode video packet"sv;
+    return -1;
+  }
+  ctx->stats->observe(stats::ENCODE_TIME, std::chrono::steady_clock::now() - start);
+
+  frame->pict_type = AV_PICTURE_TYPE_NONE;
+  frame->key_frame = 0;
+
+  return 0;
+}
+
 encode_e encode_run_sync(std::vector<std::unique_ptr<sync_session_ctx_t>> &synced_session_ctxs, encode_session_ctx_queue_t &encode_session_ctx_queue) {
   const auto &encoder = encoders.front();
 
@@ -1149,6 +1187,13 @@ encode_e encode_run_sync(std::vector<std::unique_ptr<sync_session_ctx_t>> &synce
     synced_sessions.emplace_back(std::move(*synced_session));
   }
 
+  // One encoding thread per additional stream, the capture thread encodes for the first
+  auto pool_size = std::max(config::stream.channels - 1, 0);
+  util::ThreadPool encode_pool { pool_size };
+
+  std::vector<sync_session_t *> due_sessions;
+  std::vector<std::pair<sync_session_t *, std::future<int>>> encode_results;
+
   auto next_frame = std::chrono::steady_clock::now();
   while(encode_session_ctx_queue.running()) {
     while(encode_session_ctx_queue.peek()) {
@@ -1171,7 +1216,10 @@ encode_e encode_run_sync(std::vector<std::unique_ptr<sync_session_ctx_t>> &synce
 
     auto delay = std::max(0ms, std::chrono::duration_cast<std::chrono::milliseconds>(next_frame - std::chrono::steady_clock::now()));
 
+    trace::scope_t span { "video", "snapshot" };
     auto status = disp->snapshot(img.get(), delay, display_cursor);
+    span.end();
+
     switch(status) {
     case platf::capture_e::reinit:
     case platf::capture_e::error:
@@ -1236,7 +1284,9 @@ encode_e encode_run_sync(std::vector<std::unique_ptr<sync_session_ctx_t>> &synce
         continue;
       }
 
+      // The hardware device shares the display's context, conversion has to stay on this thread
       if(pos->img_tmp) {
+        auto start = std::chrono::steady_clock::now();
         if(pos->hwdevice->convert(*pos->img_tmp)) {
           BOOST_LOG(error) << "Could not convert image"sv;
           ctx->shutdown_event->raise(true);
@@ -1244,22 +1294,50 @@ encode_e encode_run_sync(std::vector<std::unique_ptr<sync_session_ctx_t>> &synce
           continue;
         }
         pos->img_tmp = nullptr;
-      }
-
-      if(encode(ctx->frame_nr++, pos->session, frame, ctx->packets, ctx->channel_data)) {
-        BOOST_LOG(error) << "Could not encode video packet"sv;
-        ctx->shutdown_event->raise(true);
+        auto end     = std::chrono::steady_clock::now();
 
-        continue;
+        ctx->stats->add(stats::FRAMES_CAPTURED);
+        ctx->stats->observe(stats::CONVERT_TIME, end - start);
+        trace::record("video", "convert", start, end);
       }
 
-      frame->pict_type = AV_PICTURE_TYPE_NONE;
-      frame->key_frame = 0;
+      due_sessions.emplace_back(&*pos);
 
       ++pos;
     })
 
     img_tmp = nullptr;
+
+    if(due_sessions.empty()) {
+      continue;
+    }
+
+    // Encode all due sessions at once, this thread takes the last one
+    // All encoders must be finished before the next snapshot reuses their frames
+    auto last = due_sessions.back();
+    due_sessions.pop_back();
+
+    for(auto session_p : due_sessions) {
+      if(pool_size) {
+        encode_results.emplace_back(session_p, encode_pool.push(encode_synced, session_p));
+      }
+      else if(encode_synced(session_p)) {
+        session_p->ctx->shutdown_event->raise(true);
+      }
+    }
+
+    if(encode_synced(last)) {
+      last->ctx->shutdown_event->raise(true);
+    }
+
+    for(auto &[session_p, result] : encode_results) {
+      if(result.get()) {
+        session_p->ctx->shutdown_event->raise(true);
+      }
+    }
+
+    encode_results.clear();
+    due_sessions.clear();
   }
 
   return encode_e::ok;
@@ -1291,6 +1369,8 @@ void captureThreadSync() {
 void capture_async(
   safe::mail_t mail,
   config_t &config,
+  packet_sink_t sink,
+  stats::session_t &stats,
   void *channel_data) {
 
   auto shutdown_event = mail->event<bool>(mail::shutdown);
@@ -1358,6 +1438,8 @@ void capture_async(
       config, display->width, display->height,
       hwdevice.get(),
       ref->reinit_event, *ref->encoder_p,
+      sink,
+      stats,
       channel_data);
   }
 }
@@ -1365,13 +1447,15 @@ void capture_async(
 void capture(
   safe::mail_t mail,
   config_t config,
+  packet_sink_t sink,
+  stats::session_t &stats,
   void *channel_data) {
 
   auto idr_events = mail->event<idr_t>(mail::idr);
 
   idr_events->raise(std::make_pair(0, 1));
   if(encoders.front().flags & SYSTEM_MEMORY) {
-    capture_async(std::move(mail), config, channel_data);
+    capture_async(std::move(mail), config, std::move(sink), stats, channel_data);
   }
   else {
     safe::signal_t join_event;
@@ -1379,12 +1463,13 @@ void capture(
     ref->encode_session_ctx_queue.raise(sync_session_ctx_t {
       &join_event,
       mail->event<bool>(mail::shutdown),
-      mail::man->queue<packet_t>(mail::video_packets),
+      std::move(sink),
       std::move(idr_events),
       mail->event<input::touch_port_t>(mail::touch_port),
       config,
       1,
       1,
+      &stats,
       channel_data,
     });
 
@@ -1427,9 +1512,14 @@ int validate_config(std::shared_ptr<platf::display_t> &disp, const encoder_t &en
 
   frame->pict_type = AV_PICTURE_TYPE_I;
 
-  auto packets = mail::man->queue<packet_t>(mail::video_packets);
+  auto packets = std::make_shared<packet_queue_t::element_type>(30);
+
+  packet_sink_t sink = [&packets](packet_t &&packet) {
+    packets->raise(std::move(packet));
+  };
+
   while(!packets->peek()) {
-    if(encode(1, *session, frame, packets, nullptr)) {
+    if(encode(1, *session, frame, sink, nullptr)) {
       return -1;
     }
   }
@@ -1675,7 +1765,14 @@ util::Either<buffer_t, int> vaapi_make_hwdevice_ctx(platf::hwdevice_t *base) {
 #ifdef _WIN32
 }
 
-void do_nothing(void *) {}
+// Encoders may run on multiple threads at once, they share the display's immediate context
+void lock_device(void *lock) {
+  ((std::mutex *)lock)->lock();
+}
+
+void unlock_device(void *lock) {
+  ((std::mutex *)lock)->unlock();
+}
 
 namespace video {
 util::Either<buffer_t, int> dxgi_make_hwdevice_ctx(platf::hwdevice_t *hwdevice_ctx) {
@@ -1689,9 +1786,11 @@ util::Either<buffer_t, int> dxgi_make_hwdevice_ctx(platf::hwdevice_t *hwdevice_c
   device->AddRef();
   ctx->device = device;
 
-  ctx->lock_ctx = (void *)1;
-  ctx->lock     = do_nothing;
-  ctx->unlock   = do_nothing;
+  static std::mutex device_lock;
+
+  ctx->lock_ctx = &device_lock;
+  ctx->lock     = lock_device;
+  ctx->unlock   = unlock_device;
 
   auto err = av_hwdevice_ctx_init(ctx_buf.get());
   if(err) {
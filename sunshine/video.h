@@ -5,8 +5,12 @@
 #ifndef SUNSHINE_VIDEO_H
 #define SUNSHINE_VIDEO_H
 
+#include <functional>
+
 #include "input.h"
+#include "main.h"
 #include "platform/common.h"
+#include "stats.h"
 #include "thread_safe.h"
 
 extern "C" {
@@ -56,8 +60,12 @@ struct packet_raw_t : public AVPacket {
   void *channel_data;
 };
 
-using packet_t = std::unique_ptr<packet_raw_t>;
-using idr_t    = std::pair<int64_t, int64_t>;
+using packet_t       = std::unique_ptr<packet_raw_t>;
+using packet_queue_t = std::shared_ptr<safe::queue_t<packet_t>>;
+using idr_t          = std::pair<int64_t, int64_t>;
+
+// Called on the encoding thread for every encoded packet
+using packet_sink_t = std::function<void(packet_t &&packet)>;
 
 struct config_t {
   int width;
@@ -85,12 +93,23 @@ struct __attribute__((__aligned__(16))) color_t {
 
 extern color_t colors[4];
 
+/**
+ * Capture and encode video until the session shuts down
+ * @param sink Receives the encoded packets, tagged with channel_data
+ * @param stats Collects the conversion and encoding times of the session
+ */
 void capture(
   safe::mail_t mail,
   config_t config,
+  packet_sink_t sink,
+  stats::session_t &stats,
   void *channel_data);
 
 int init();
 } // namespace video
 
+namespace mail {
+constexpr auto idr = safe::mail_id_t<safe::event_t<video::idr_t>, IDR> {};
+} // namespace mail
+
 #endif //SUNSHINE_VIDEO_H
@@ -0,0 +1,163 @@
+//
+// Compares safe::queue_t against the mutex and std::vector queue it replaced
+//
+
+#include <iostream>
+#include <thread>
+
+#include "sunshine/thread_safe.h"
+
+using namespace std::literals;
+
+/**
+ * The previous implementation of safe::queue_t
+ */
+template<class T>
+class mutex_queue_t {
+public:
+  using status_t = util::optional_t<T>;
+
+  mutex_queue_t(std::uint32_t max_elements, safe::overflow_e = safe::overflow_e::block) : _max_elements { max_elements } {}
+
+  template<class... Args>
+  void raise(Args &&...args) {
+    std::unique_lock ul { _lock };
+
+    _space_cv.wait(ul, [this]() { return !_continue || _queue.size() < _max_elements; });
+    if(!_continue) {
+      return;
+    }
+
+    _queue.emplace_back(std::forward<Args>(args)...);
+
+    _cv.notify_all();
+  }
+
+  status_t pop() {
+    std::unique_lock ul { _lock };
+
+    if(!_continue) {
+      return util::false_v<status_t>;
+    }
+
+    while(_queue.empty()) {
+      _cv.wait(ul);
+
+      if(!_continue) {
+        return util::false_v<status_t>;
+      }
+    }
+
+    auto val = std::move(_queue.front());
+    _queue.erase(std::begin(_queue));
+
+    _space_cv.notify_one();
+
+    return val;
+  }
+
+  void stop() {
+    std::lock_guard lg { _lock };
+
+    _continue = false;
+
+    _cv.notify_all();
+    _space_cv.notify_all();
+  }
+
+private:
+  bool _continue { true };
+  std::uint32_t _max_elements;
+
+  std::mutex _lock;
+  std::condition_variable _cv;
+  std::condition_variable _space_cv;
+
+  std::vector<T> _queue;
+};
+
+constexpr std::uint32_t QUEUE_SIZE = 32;
+constexpr int ELEMENTS             = 1000000;
+
+/**
+ * Push ELEMENTS through the queue from each producer to a single consumer
+ * @return nanoseconds per element
+ */
+template<class Q>
+double throughput(int producers) {
+  Q queue { QUEUE_SIZE, safe::overflow_e::block };
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> threads;
+  for(int x = 0; x < producers; ++x) {
+    threads.emplace_back([&queue]() {
+      for(int y = 0; y < ELEMENTS; ++y) {
+        queue.raise(y);
+      }
+    });
+  }
+
+  std::int64_t sum = 0;
+  for(int x = 0; x < ELEMENTS * producers; ++x) {
+    sum += *queue.pop();
+  }
+
+  auto end = std::chrono::steady_clock::now();
+
+  for(auto &thread : threads) {
+    thread.join();
+  }
+
+  if(sum != (std::int64_t)ELEMENTS * (ELEMENTS - 1) / 2 * producers) {
+    std::cout << "Elements were lost or duplicated"sv << std::endl;
+  }
+
+  return std::chrono::duration<double, std::nano>(end - start).count() / (ELEMENTS * producers);
+}
+
+/**
+ * Bounce a single element between two threads, waking the other side each time
+ * @return nanoseconds per round trip
+ */
+template<class Q>
+double round_trip() {
+  constexpr int ROUND_TRIPS = ELEMENTS / 10;
+
+  Q ping { QUEUE_SIZE, safe::overflow_e::block };
+  Q pong { QUEUE_SIZE, safe::overflow_e::block };
+
+  std::thread thread { [&]() {
+    for(int x = 0; x < ROUND_TRIPS; ++x) {
+      pong.raise(*ping.pop());
+    }
+  } };
+
+  auto start = std::chrono::steady_clock::now();
+  for(int x = 0; x < ROUND_TRIPS; ++x) {
+    ping.raise(x);
+    pong.pop();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  thread.join();
+
+  return std::chrono::duration<double, std::nano>(end - start).count() / ROUND_TRIPS;
+}
+
+int main(int argc, char *argv[]) {
+  using mpsc_t = safe::queue_t<int>;
+  using spsc_t = safe::queue_t<int, safe::producer_e::single>;
+
+  std::cout << "ns per element"sv << std::endl;
+  std::cout << "\tspsc:       mutex "sv << throughput<mutex_queue_t<int>>(1) << " | ring "sv << throughput<spsc_t>(1) << std::endl;
+
+  for(auto producers : { 1, 2, 4 }) {
+    std::cout << "\tmpsc ["sv << producers << "]:   mutex "sv << throughput<mutex_queue_t<int>>(producers) << " | ring "sv << throughput<mpsc_t>(producers) << std::endl;
+  }
+
+  std::cout << "ns per round trip"sv << std::endl;
+  std::cout << "\tmutex "sv << round_trip<mutex_queue_t<int>>() << " | ring "sv << round_trip<mpsc_t>() << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,186 @@
+//
+// Compares the timer heap of util::TaskPool against the sorted std::vector it replaced
+//
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "sunshine/task_pool.h"
+
+using namespace std::literals;
+
+using time_point_t = std::chrono::steady_clock::time_point;
+using task_t       = util::TaskPool::__task;
+using task_id_t    = util::TaskPool::task_id_t;
+
+/**
+ * The previous timer implementation of util::TaskPool
+ */
+class vector_timers_t {
+public:
+  void pushDelayed(std::pair<time_point_t, task_t> &&task) {
+    std::lock_guard lg(_task_mutex);
+
+    auto it = _timer_tasks.cbegin();
+    for(; it < _timer_tasks.cend(); ++it) {
+      if(std::get<0>(*it) < task.first) {
+        break;
+      }
+    }
+
+    _timer_tasks.emplace(it, task.first, std::move(task.second));
+  }
+
+  bool cancel(task_id_t task_id) {
+    std::lock_guard lg(_task_mutex);
+
+    auto it = _timer_tasks.begin();
+    for(; it < _timer_tasks.cend(); ++it) {
+      if(&*std::get<1>(*it) == task_id) {
+        _timer_tasks.erase(it);
+
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  std::optional<task_t> pop() {
+    std::lock_guard lg(_task_mutex);
+
+    if(!_timer_tasks.empty() && std::get<0>(_timer_tasks.back()) <= std::chrono::steady_clock::now()) {
+      task_t task = std::move(std::get<1>(_timer_tasks.back()));
+      _timer_tasks.pop_back();
+
+      return std::move(task);
+    }
+
+    return std::nullopt;
+  }
+
+  std::optional<time_point_t> next() {
+    std::lock_guard lg(_task_mutex);
+
+    if(_timer_tasks.empty()) {
+      return std::nullopt;
+    }
+
+    return std::get<0>(_timer_tasks.back());
+  }
+
+private:
+  std::vector<std::pair<time_point_t, task_t>> _timer_tasks;
+  std::mutex _task_mutex;
+};
+
+template<class F>
+task_t make_task(F &&f) {
+  return std::make_unique<util::_Impl<F>>(std::forward<F>(f));
+}
+
+// Timers that are armed, but never fire during the benchmark
+constexpr int IDLE_TIMERS = 5000;
+
+/**
+ * Fire a timer every millisecond, like input::repeat_key, while another thread keeps
+ * pushing and cancelling timers, like the mouse and back button timeouts
+ */
+template<class P>
+void bench(const char *name) {
+  P pool;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  bool running = true;
+
+  auto push = [&](time_point_t tp, task_t &&task) {
+    task_id_t task_id = task.get();
+
+    std::lock_guard lg(lock);
+    pool.pushDelayed(std::pair { tp, std::move(task) });
+    cv.notify_one();
+
+    return task_id;
+  };
+
+  for(int x = 0; x < IDLE_TIMERS; ++x) {
+    push(std::chrono::steady_clock::now() + 1h + std::chrono::milliseconds { x }, make_task([]() {}));
+  }
+
+  std::vector<double> jitter;
+
+  std::function<void(time_point_t)> repeat = [&](time_point_t due) {
+    jitter.emplace_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - due).count());
+
+    auto next = due + 1ms;
+    push(next, make_task([&repeat, next]() { repeat(next); }));
+  };
+
+  auto start = std::chrono::steady_clock::now() + 1ms;
+  push(start, make_task([&repeat, start]() { repeat(start); }));
+
+  std::thread timer_thread { [&]() {
+    while(running) {
+      if(auto task = pool.pop()) {
+        (*task)->run();
+
+        continue;
+      }
+
+      std::unique_lock ul(lock);
+      if(!running) {
+        break;
+      }
+
+      if(auto tp = pool.next()) {
+        cv.wait_until(ul, *tp);
+      }
+      else {
+        cv.wait(ul);
+      }
+    }
+  } };
+
+  std::mt19937 rng;
+  std::uniform_int_distribution<int> dist { 1, 1000 };
+
+  std::int64_t churn = 0;
+  auto end           = std::chrono::steady_clock::now() + 2s;
+  while(std::chrono::steady_clock::now() < end) {
+    auto task_id = push(std::chrono::steady_clock::now() + 1s + std::chrono::milliseconds { dist(rng) }, make_task([]() {}));
+    pool.cancel(task_id);
+
+    ++churn;
+  }
+
+  {
+    std::lock_guard lg(lock);
+    running = false;
+    cv.notify_all();
+  }
+  timer_thread.join();
+
+  std::sort(std::begin(jitter), std::end(jitter));
+
+  double sum = 0;
+  for(auto j : jitter) {
+    sum += j;
+  }
+
+  std::cout << name << ":"sv << std::endl
+            << "\tpush + cancel: "sv << churn / 2 << " per second"sv << std::endl
+            << "\tjitter [us]: mean "sv << sum / jitter.size()
+            << " | p99 "sv << jitter[jitter.size() * 99 / 100]
+            << " | max "sv << jitter.back() << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  bench<vector_timers_t>("sorted vector");
+  bench<util::TaskPool>("indexed heap");
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+//
+// Drives a synthetic gamepad through uinput, once with a syscall per event and once batched per report
+// Requires write access to /dev/uinput
+//
+
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include <libevdev/libevdev-uinput.h>
+#include <libevdev/libevdev.h>
+
+#include "sunshine/platform/linux/uinput.h"
+#include "sunshine/utility.h"
+
+using namespace std::literals;
+
+using evdev_t  = util::safe_ptr<libevdev, libevdev_free>;
+using uinput_t = util::safe_ptr<libevdev_uinput, libevdev_uinput_destroy>;
+
+constexpr auto DURATION = 2s;
+
+constexpr int BUTTONS[] {
+  BTN_START, BTN_SELECT, BTN_THUMBL, BTN_THUMBR, BTN_TL, BTN_TR,
+  BTN_MODE, BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST
+};
+
+constexpr int AXES[] {
+  ABS_Z, ABS_RZ, ABS_X, ABS_Y, ABS_RX, ABS_RY
+};
+
+uinput_t gamepad() {
+  evdev_t dev { libevdev_new() };
+
+  libevdev_set_name(dev.get(), "Sunshine uinput bench");
+
+  libevdev_enable_event_type(dev.get(), EV_KEY);
+  for(auto button : BUTTONS) {
+    libevdev_enable_event_code(dev.get(), EV_KEY, button, nullptr);
+  }
+
+  input_absinfo stick { 0, -32768, 32767, 16, 128, 0 };
+  input_absinfo dpad { 0, -1, 1, 0, 0, 0 };
+
+  libevdev_enable_event_type(dev.get(), EV_ABS);
+  for(auto axis : AXES) {
+    libevdev_enable_event_code(dev.get(), EV_ABS, axis, &stick);
+  }
+  libevdev_enable_event_code(dev.get(), EV_ABS, ABS_HAT0X, &dpad);
+  libevdev_enable_event_code(dev.get(), EV_ABS, ABS_HAT0Y, &dpad);
+
+  uinput_t uinput;
+  int err = libevdev_uinput_create_from_device(dev.get(), LIBEVDEV_UINPUT_OPEN_MANAGED, &uinput);
+  if(err) {
+    std::cout << "Could not create uinput device: "sv << strerror(-err) << std::endl;
+  }
+
+  return uinput;
+}
+
+/**
+ * Send the worst case the controller input produces: every button and axis changing in each report
+ * @param write Writes a single event, and returns the number of syscalls it issued
+ */
+template<class F, class R>
+void run(const char *name, F &&write, R &&report) {
+  std::default_random_engine engine;
+  std::uniform_int_distribution<int> value { -32768, 32767 };
+
+  std::uint64_t reports = 0, syscalls = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  auto end   = start + DURATION;
+  while(std::chrono::steady_clock::now() < end) {
+    for(auto button : BUTTONS) {
+      syscalls += write(EV_KEY, button, reports & 1);
+    }
+
+    syscalls += write(EV_ABS, ABS_HAT0X, (reports & 1) ? 1 : 0);
+    syscalls += write(EV_ABS, ABS_HAT0Y, (reports & 1) ? -1 : 0);
+
+    for(auto axis : AXES) {
+      syscalls += write(EV_ABS, axis, value(engine));
+    }
+
+    syscalls += report();
+    ++reports;
+  }
+
+  auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << name << ": "sv
+            << reports / seconds << " reports/s, "sv
+            << syscalls / seconds << " syscalls/s, "sv
+            << (double)syscalls / reports << " syscalls per report"sv << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  auto uinput = gamepad();
+  if(!uinput) {
+    return 1;
+  }
+
+  run(
+    "libevdev_uinput_write_event",
+    [&](int type, int code, int value) {
+      libevdev_uinput_write_event(uinput.get(), type, code, value);
+      return 1;
+    },
+    [&]() {
+      libevdev_uinput_write_event(uinput.get(), EV_SYN, SYN_REPORT, 0);
+      return 1;
+    });
+
+  platf::uinput::stats_t stats {};
+  platf::uinput::batch_t batch { uinput.get(), stats };
+  run(
+    "batch_t",
+    [&](int type, int code, int value) {
+      batch.event(type, code, value);
+      return 0;
+    },
+    [&]() {
+      auto writes = stats.writes.load();
+      batch.report();
+
+      return stats.writes - writes;
+    });
+
+  return 0;
+}